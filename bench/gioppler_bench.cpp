@@ -0,0 +1,220 @@
+// Copyright (c) 2022 Carlos Reyes
+// This code is licensed under the permissive MIT License (MIT).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Microbenchmarks for the library's own hot paths.
+// Prints ns/op per benchmark and writes JSON lines (one object per
+// benchmark) so results can be diffed across commits:
+//   gioppler_bench [results.json]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gioppler/gioppler.hpp"
+#include "gioppler/counter.hpp"
+#include "gioppler/histogram.hpp"
+
+using namespace gioppler;
+using namespace gioppler::histogram;
+
+// -----------------------------------------------------------------------------
+/// defeat dead-code elimination without fencing the measured loop
+volatile uint64_t g_bench_sink;
+
+struct BenchResult {
+  std::string name;
+  double      ns_per_op;
+  uint64_t    iterations;
+};
+
+static std::vector<BenchResult> g_results;
+
+// -----------------------------------------------------------------------------
+/// time one operation over the given iteration count, after a short warmup
+template<typename Operation>
+void run_benchmark(const std::string name, const uint64_t iterations, Operation&& operation)
+{
+  for (uint64_t i = 0; i < iterations/10+1; ++i) {   // warmup
+    operation(i);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    operation(i);
+  }
+  const auto elapsed = std::chrono::steady_clock::now()-start;
+
+  const double ns_per_op =
+      std::chrono::duration<double, std::nano>(elapsed).count()/static_cast<double>(iterations);
+  std::printf("%-32s %10.1f ns/op  %12lu iterations\n",
+              name.c_str(), ns_per_op, static_cast<unsigned long>(iterations));
+  g_results.emplace_back(BenchResult{name, ns_per_op, iterations});
+}
+
+// -----------------------------------------------------------------------------
+/// record acquisition from the pool plus field initialization
+static void bench_record_construction()
+{
+  run_benchmark("record_construction", 1'000'000, [](const uint64_t i) {
+    std::shared_ptr<Record> record = get_thread().record_pool().make_record({
+        {"category"_rk, "bench"},
+        {"value"_rk,    static_cast<int64_t>(i)},
+        {"message"_rk,  "benchmark record"}});
+    g_bench_sink = record->field_count();
+  });
+}
+
+// -----------------------------------------------------------------------------
+/// JSON serialization of a representative record, excluding file output
+static void bench_json_serialize()
+{
+  const std::shared_ptr<Record> record = get_thread().record_pool().make_record({
+      {"category"_rk, "bench"},
+      {"value"_rk,    INT64_C(1234567)},
+      {"message"_rk,  "a \"quoted\" message with\ttabs"}});
+  record->set_site(get_source_location_record(std::source_location::current()));
+
+  std::string buffer;
+  run_benchmark("json_serialize", 1'000'000, [&](uint64_t) {
+    buffer.clear();
+    sink::append_record_json(buffer, *record);
+    g_bench_sink = buffer.size();
+  });
+}
+
+// -----------------------------------------------------------------------------
+/// CSV serialization through the Csv sink, including its buffered write
+static void bench_csv_serialize()
+{
+  sink::Csv csv_sink{{"category", "value", "message"}, "<temp>"sv};
+  const std::shared_ptr<Record> record = get_thread().record_pool().make_record({
+      {"category"_rk, "bench"},
+      {"value"_rk,    INT64_C(1234567)},
+      {"message"_rk,  "a \"quoted\" message"}});
+
+  run_benchmark("csv_serialize", 100'000, [&](uint64_t) {
+    csv_sink.write_records({&record, 1});
+  });
+}
+
+// -----------------------------------------------------------------------------
+/// enqueue throughput of SinkManager::write_record with N producer threads
+static void bench_sink_manager_write()
+{
+  sink::Json::add_sink("<temp>"sv);
+
+  constexpr int      producers        = 4;
+  constexpr uint64_t records_per_each = 100'000;
+
+  const auto start = std::chrono::steady_clock::now();
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(producers);
+    for (int p = 0; p < producers; ++p) {
+      threads.emplace_back([] {
+        for (uint64_t i = 0; i < records_per_each; ++i) {
+          sink::get_sink_manager().write_record(get_thread().record_pool().make_record({
+              {"category"_rk, "bench"},
+              {"value"_rk,    static_cast<int64_t>(i)}}));
+        }
+      });
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now()-start;
+
+  constexpr uint64_t total = producers*records_per_each;
+  const double ns_per_op =
+      std::chrono::duration<double, std::nano>(elapsed).count()/static_cast<double>(total);
+  std::printf("%-32s %10.1f ns/op  %12lu iterations\n",
+              "sink_manager_write_4threads", ns_per_op, static_cast<unsigned long>(total));
+  g_results.emplace_back(BenchResult{"sink_manager_write_4threads", ns_per_op, total});
+}
+
+// -----------------------------------------------------------------------------
+/// histogram insertion, dynamic and fixed-capacity variants
+static void bench_histogram_add()
+{
+  Histogram dynamic_hist;
+  run_benchmark("histogram_add_observation", 10'000'000, [&](const uint64_t i) {
+    dynamic_hist.add_observation(i*2654435761u & 0xffffffu);
+  });
+
+  FixedHistogram<256> fixed_hist;
+  run_benchmark("fixed_histogram_add_observation", 10'000'000, [&](const uint64_t i) {
+    fixed_hist.add_observation(i*2654435761u & 0xffffffu);
+  });
+  g_bench_sink = dynamic_hist.get_count()+fixed_hist.get_count();
+}
+
+// -----------------------------------------------------------------------------
+/// cost of a passing contract check in this build mode
+static void bench_contract_check()
+{
+  run_benchmark("contract_expect_pass", 100'000'000, [](const uint64_t i) {
+    contract::expect(i+1 > 0);
+  });
+}
+
+// -----------------------------------------------------------------------------
+/// latency of one full performance counter snapshot
+static void bench_events_snapshot()
+{
+  linux::LinuxEvents& events = linux::get_thread_events();
+  events.enable_events();
+  run_benchmark("linux_events_get_snapshot", 50'000, [&](uint64_t) {
+    linux::LinuxEventsData data = events.get_snapshot();
+    g_bench_sink = static_cast<uint64_t>(data.get_cpu_seconds());
+  });
+}
+
+// -----------------------------------------------------------------------------
+/// one JSON object per line, so results diff cleanly across commits
+static void write_results(const std::string& path)
+{
+  std::ofstream output{path};
+  for (const BenchResult& result : g_results) {
+    output << "{\"benchmark\":\"" << result.name
+           << "\",\"ns_per_op\":" << result.ns_per_op
+           << ",\"iterations\":" << result.iterations
+           << "}\n";
+  }
+  std::printf("results written to %s\n", path.c_str());
+}
+
+// -----------------------------------------------------------------------------
+int main(const int argc, const char* argv[])
+{
+  bench_record_construction();
+  bench_json_serialize();
+  bench_csv_serialize();
+  bench_sink_manager_write();
+  bench_histogram_add();
+  bench_contract_check();
+  bench_events_snapshot();
+
+  write_results(argc > 1 ? argv[1] : "gioppler_bench.json");
+  return 0;
+}
@@ -0,0 +1,220 @@
+// Copyright (c) 2022 Carlos Reyes
+// This code is licensed under the permissive MIT License (MIT).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+#ifndef GIOPPLER_COMPRESS_HPP
+#define GIOPPLER_COMPRESS_HPP
+
+#if __cplusplus < 202002L
+#error C++20 or newer support required to use this library.
+#endif
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "gioppler/config.hpp"
+
+// optional codecs - the wrapper degrades to pass-through when absent
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define GIOPPLER_HAVE_ZSTD 1
+#endif
+#if __has_include(<lz4frame.h>)
+#include <lz4frame.h>
+#define GIOPPLER_HAVE_LZ4 1
+#endif
+
+// -----------------------------------------------------------------------------
+namespace gioppler::sink {
+
+// -----------------------------------------------------------------------------
+/// compression codec for file sinks
+// None passes bytes through untouched; Zstd and Lz4 require the matching
+// development headers at build time and fall back to None with a warning
+// when the library was not available.
+enum class Compression {None, Zstd, Lz4};
+
+// -----------------------------------------------------------------------------
+/// stream buffer that compresses its output in independent frames
+// Bytes accumulate in a chunk buffer; a full chunk or an explicit flush is
+// compressed as one complete zstd/LZ4 frame and appended to the underlying
+// stream. Concatenated frames are exactly what the zstd and lz4 tools
+// expect, and every closed frame decodes on its own, so a file cut short by
+// a crash is readable up to the last flushed frame. Sinks flush at batch
+// boundaries, which makes a frame per batch.
+// Compression runs in the sink's writer thread; producers never pay for it.
+class CompressedStreamBuf final : public std::streambuf {
+ public:
+  CompressedStreamBuf(std::unique_ptr<std::ostream> downstream,
+                      const Compression compression, const int level)
+  : _downstream(std::move(downstream)), _compression(compression), _level(level)
+  {
+    _chunk.resize(chunk_size);
+    setp(_chunk.data(), _chunk.data()+_chunk.size());
+  }
+
+  CompressedStreamBuf(const CompressedStreamBuf&) = delete;
+  CompressedStreamBuf& operator=(const CompressedStreamBuf&) = delete;
+
+  ~CompressedStreamBuf() override {
+    emit_frame();
+  }
+
+ protected:
+  int_type overflow(const int_type character) override {
+    emit_frame();
+    if (!traits_type::eq_int_type(character, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(character);
+      pbump(1);
+    }
+    return traits_type::not_eof(character);
+  }
+
+  std::streamsize xsputn(const char* data, const std::streamsize size) override {
+    std::streamsize remaining = size;
+    while (remaining > 0) {
+      std::streamsize room = epptr()-pptr();
+      if (room == 0) {
+        emit_frame();
+        room = epptr()-pptr();
+      }
+      const std::streamsize step = std::min(remaining, room);
+      std::memcpy(pptr(), data, static_cast<size_t>(step));
+      pbump(static_cast<int>(step));
+      data      += step;
+      remaining -= step;
+    }
+    return size;
+  }
+
+  /// close the current frame so everything written so far is decodable
+  int sync() override {
+    emit_frame();
+    _downstream->flush();
+    return 0;
+  }
+
+ private:
+  static constexpr size_t chunk_size = 256*1024;
+
+  /// compress the accumulated chunk as one frame and pass it downstream
+  void emit_frame() {
+    const size_t length = static_cast<size_t>(pptr()-pbase());
+    if (length == 0)   return;
+    setp(_chunk.data(), _chunk.data()+_chunk.size());
+
+    switch (_compression) {
+#if defined(GIOPPLER_HAVE_ZSTD)
+      case Compression::Zstd: {
+        _frame.resize(ZSTD_compressBound(length));
+        const size_t frame_size = ZSTD_compress(_frame.data(), _frame.size(),
+                                                _chunk.data(), length, _level);
+        if (ZSTD_isError(frame_size)) {
+          std::cerr << "ERROR: CompressedStreamBuf: " << ZSTD_getErrorName(frame_size) << std::endl;
+          return;
+        }
+        _downstream->write(_frame.data(), static_cast<std::streamsize>(frame_size));
+        return;
+      }
+#endif
+
+#if defined(GIOPPLER_HAVE_LZ4)
+      case Compression::Lz4: {
+        LZ4F_preferences_t preferences{};
+        preferences.compressionLevel = _level;
+        _frame.resize(LZ4F_compressFrameBound(length, &preferences));
+        const size_t frame_size = LZ4F_compressFrame(_frame.data(), _frame.size(),
+                                                     _chunk.data(), length, &preferences);
+        if (LZ4F_isError(frame_size)) {
+          std::cerr << "ERROR: CompressedStreamBuf: " << LZ4F_getErrorName(frame_size) << std::endl;
+          return;
+        }
+        _downstream->write(_frame.data(), static_cast<std::streamsize>(frame_size));
+        return;
+      }
+#endif
+
+      default: {   // None, or a codec this build does not have
+        _downstream->write(_chunk.data(), static_cast<std::streamsize>(length));
+        return;
+      }
+    }
+  }
+
+  std::unique_ptr<std::ostream> _downstream;
+  Compression _compression;
+  int _level;
+  std::vector<char> _chunk;   // uncompressed bytes for the open frame
+  std::vector<char> _frame;   // reused compressed-frame scratch buffer
+};
+
+// -----------------------------------------------------------------------------
+/// output stream owning a compressing stream buffer
+class CompressedStream final : public std::ostream {
+ public:
+  CompressedStream(std::unique_ptr<std::ostream> downstream,
+                   const Compression compression, const int level)
+  : std::ostream(nullptr), _buf(std::move(downstream), compression, level) {
+    rdbuf(&_buf);
+  }
+
+ private:
+  CompressedStreamBuf _buf;
+};
+
+// -----------------------------------------------------------------------------
+/// wrap a sink's output stream in the requested compression, if any
+// warns and passes through when the codec was not compiled in
+std::unique_ptr<std::ostream>
+wrap_compressed(std::unique_ptr<std::ostream> downstream,
+                const Compression compression, const int level = 3)
+{
+  if (compression == Compression::None) {
+    return downstream;
+  }
+
+#if !defined(GIOPPLER_HAVE_ZSTD)
+  if (compression == Compression::Zstd) {
+    std::cerr << "WARNING: gioppler built without zstd; writing uncompressed" << std::endl;
+    return downstream;
+  }
+#endif
+#if !defined(GIOPPLER_HAVE_LZ4)
+  if (compression == Compression::Lz4) {
+    std::cerr << "WARNING: gioppler built without lz4; writing uncompressed" << std::endl;
+    return downstream;
+  }
+#endif
+
+  return std::make_unique<CompressedStream>(std::move(downstream), compression, level);
+}
+
+// -----------------------------------------------------------------------------
+}   // namespace gioppler::sink
+
+// -----------------------------------------------------------------------------
+#endif // defined GIOPPLER_COMPRESS_HPP
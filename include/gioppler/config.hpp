@@ -28,6 +28,8 @@
 #endif
 
 #include <string>
+#include <string_view>
+#include <cstddef>
 #include <cstdint>
 
 // -----------------------------------------------------------------------------
@@ -55,6 +57,52 @@ constexpr static inline BuildMode g_build_mode = BuildMode::Prod;
 constexpr static inline BuildMode g_build_mode = BuildMode::Off;
 #endif
 
+// -----------------------------------------------------------------------------
+/// a subsystem name usable as a template argument: Function<"network">
+// structural type holding the characters by value, so the name takes part
+// in template identity and is readable at compile time
+template<std::size_t N>
+struct SubsystemName {
+  consteval SubsystemName(const char (&name)[N]) {
+    for (std::size_t index = 0; index < N; ++index) {
+      _name[index] = name[index];
+    }
+  }
+
+  [[nodiscard]] constexpr std::string_view view() const {
+    return std::string_view{_name, N-1};   // drop the terminating NUL
+  }
+
+  char _name[N];
+};
+
+// -----------------------------------------------------------------------------
+// Comma-separated list of profiling subsystems to compile in, or "*" for all
+// of them. Instrumentation for subsystems not on the list instantiates the
+// empty BuildMode::Off-style body and costs nothing at runtime, so it can be
+// left in the source for every subsystem. Normally set from the build files:
+//   -DGIOPPLER_SUBSYSTEMS=network,disk
+#if defined(GIOPPLER_SUBSYSTEMS)
+#define GIOPPLER_STRINGIZE_IMPL(...) #__VA_ARGS__   // variadic: the list contains commas
+#define GIOPPLER_STRINGIZE(...) GIOPPLER_STRINGIZE_IMPL(__VA_ARGS__)
+constexpr static inline std::string_view g_enabled_subsystems = GIOPPLER_STRINGIZE(GIOPPLER_SUBSYSTEMS);
+#else
+constexpr static inline std::string_view g_enabled_subsystems = "*";
+#endif
+
+/// is the subsystem compiled in? the unnamed subsystem always is
+consteval bool is_subsystem_enabled(const std::string_view subsystem) {
+  if (subsystem.empty() || g_enabled_subsystems == "*")   return true;
+  std::size_t position = 0;
+  while (position <= g_enabled_subsystems.size()) {
+    std::size_t comma = g_enabled_subsystems.find(',', position);
+    if (comma == std::string_view::npos)   comma = g_enabled_subsystems.size();
+    if (g_enabled_subsystems.substr(position, comma-position) == subsystem)   return true;
+    position = comma+1;
+  }
+  return false;
+}
+
 // -----------------------------------------------------------------------------
 /// Platform defines the operating system.
 // Often used to control include files, so define constants also.
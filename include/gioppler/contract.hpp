@@ -27,15 +27,17 @@
 #error C++20 or newer support required to use this library.
 #endif
 
+#include <concepts>
 #include <exception>
-#include <functional>
 #include <memory>
 #include <iostream>
 #include <source_location>
 #include <stdexcept>
+#include <utility>
 
 #include "gioppler/utility.hpp"
 #include "gioppler/sink.hpp"
+#include "gioppler/thread.hpp"
 
 // -----------------------------------------------------------------------------
 /// Contracts to ensure correct program behavior.
@@ -64,26 +66,43 @@ public:
     contract_violation& operator=(contract_violation&&) = default;
 };
 
+// -----------------------------------------------------------------------------
+/// cold slow path shared by the contract checks
+// All record building, message formatting, and throwing lives here, so the
+// success path of a contract check is a single predicted branch and the call
+// sites carry none of the failure machinery in their instruction stream.
+[[gnu::cold]] [[gnu::noinline]] [[noreturn]]
+inline void fail_contract(const std::string_view subcategory,
+                          const std::string_view what,
+                          const std::source_location &source_location)
+{
+  const std::string message =
+    format("ERROR: {}: {}\n",
+           format_source_location(source_location), what);
+  std::shared_ptr<Record> record{get_thread().record_pool().make_record({
+    {"category"_rk, "contract"},
+    {"subcategory"_rk, subcategory},
+    {"message"_rk, message}
+  })};
+  record->set_site(get_source_location_record(source_location));
+  sink::get_sink_manager().write_record(record);
+  throw contract_violation{message};
+}
+
 // -----------------------------------------------------------------------------
 /// errors that arise because an argument value has not been accepted
 // the function's expectation of its arguments upon entry into the function
 // prints error to std::cerr and throws exception
-void argument(const bool condition,
+// compiles to nothing in the Off and Prod build modes
+template<BuildMode build_mode = g_build_mode>
+void argument([[maybe_unused]] const bool condition,
               [[maybe_unused]] const std::source_location &source_location =
                 std::source_location::current())
 {
-  if (!condition) [[unlikely]] {
-    const std::string message =
-      format("ERROR: {}: invalid argument\n",
-             format_source_location(source_location));
-    std::shared_ptr<Record> record{make_shared_init_list<Record>({
-      {"category", "contract"},
-      {"subcategory", "argument"},
-      {"message", message}
-    })};
-    record->merge(source_location_to_record(source_location));
-    sink::g_sink_manager.write_record(record);
-    throw contract_violation{message};
+  if constexpr (build_mode != BuildMode::Off && build_mode != BuildMode::Prod) {
+    if (!condition) [[unlikely]] {
+      fail_contract("argument"sv, "invalid argument"sv, source_location);
+    }
   }
 }
 
@@ -91,44 +110,32 @@ void argument(const bool condition,
 /// expect conditions are like preconditions
 // the function's expectation of the state of other objects upon entry into the function
 // prints error to std::cerr and throws exception
-void expect(const bool condition,
+// compiles to nothing in the Off and Prod build modes
+template<BuildMode build_mode = g_build_mode>
+void expect([[maybe_unused]] const bool condition,
             [[maybe_unused]] const std::source_location &source_location =
               std::source_location::current())
 {
-  if (!condition) [[unlikely]] {
-    const std::string message =
-      format("ERROR: {}: expect condition failed\n",
-             format_source_location(source_location));
-    std::shared_ptr<Record> record{make_shared_init_list<Record>({
-      {"category", "contract"},
-      {"subcategory", "expect"},
-      {"message", message}
-    })};
-    record->merge(source_location_to_record(source_location));
-    sink::g_sink_manager.write_record(record);
-    throw contract_violation{message};
+  if constexpr (build_mode != BuildMode::Off && build_mode != BuildMode::Prod) {
+    if (!condition) [[unlikely]] {
+      fail_contract("expect"sv, "expect condition failed"sv, source_location);
+    }
   }
 }
 
 // -----------------------------------------------------------------------------
 /// confirms a condition that should be satisfied where it appears in a function body
 // prints error to std::cerr and throws exception
-void confirm(const bool condition,
+// compiles to nothing in the Off and Prod build modes
+template<BuildMode build_mode = g_build_mode>
+void confirm([[maybe_unused]] const bool condition,
             [[maybe_unused]] const std::source_location &source_location =
               std::source_location::current())
 {
-  if (!condition) [[unlikely]] {
-    const std::string message =
-      format("ERROR: {}: confirm failed\n",
-             format_source_location(source_location));
-    std::shared_ptr<Record> record{make_shared_init_list<Record>({
-      {"category", "contract"},
-      {"subcategory", "confirm"},
-      {"message", message}
-    })};
-    record->merge(source_location_to_record(source_location));
-    sink::g_sink_manager.write_record(record);
-    throw contract_violation{message};
+  if constexpr (build_mode != BuildMode::Off && build_mode != BuildMode::Prod) {
+    if (!condition) [[unlikely]] {
+      fail_contract("confirm"sv, "confirm failed"sv, source_location);
+    }
   }
 }
 
@@ -139,12 +146,18 @@ void confirm(const bool condition,
 
 // -----------------------------------------------------------------------------
 /// invariant condition to check on scope entry and exit
+// The callable type is a template parameter (deduced via CTAD), so the
+// lambda is stored inline and the condition inlines down to the raw check.
+// std::function here would mean a possible heap allocation and an indirect
+// call per scope - too expensive for hot paths like histogram merges.
+template<typename ConditionFunction>
+requires std::predicate<ConditionFunction>
 class Invariant {
  public:
   Invariant() = delete;
 
   // check invariant on scope entry
-  explicit Invariant(std::function<bool()> condition_function,
+  explicit Invariant(ConditionFunction condition_function,
             [[maybe_unused]] const std::source_location &source_location =
               std::source_location::current())
   : _uncaught_exceptions(std::uncaught_exceptions()),
@@ -152,17 +165,7 @@ class Invariant {
     _source_location(source_location)
   {
     if (!_condition_function()) [[unlikely]] {
-      const std::string message =
-        format("ERROR: {}: invariant failed on entry\n",
-               format_source_location(_source_location));
-        std::shared_ptr<Record> record{make_shared_init_list<Record>({
-          {"category", "contract"},
-          {"subcategory", "invariant"},
-          {"message", message}
-        })};
-        record->merge(source_location_to_record(_source_location));
-        sink::g_sink_manager.write_record(record);
-        throw contract_violation{message};
+      fail_contract("invariant"sv, "invariant failed on entry"sv, _source_location);
     }
   }
 
@@ -172,17 +175,7 @@ class Invariant {
   ~Invariant() {
     if (!_condition_function()) [[unlikely]] {
       try {
-        const std::string message =
-          format("ERROR: {}: invariant failed on exit\n",
-                 format_source_location(_source_location));
-          std::shared_ptr<Record> record{make_shared_init_list<Record>({
-            {"category", "contract"},
-            {"subcategory", "invariant"},
-            {"message", message}
-          })};
-          record->merge(source_location_to_record(_source_location));
-          sink::g_sink_manager.write_record(record);
-          throw contract_violation{message};
+        fail_contract("invariant"sv, "invariant failed on exit"sv, _source_location);
       } catch(...) {
         if (std::uncaught_exceptions() == _uncaught_exceptions) {
           throw;   // safe to rethrow
@@ -195,17 +188,20 @@ class Invariant {
 
  private:
   int _uncaught_exceptions;
-  std::function<bool()> _condition_function;
+  ConditionFunction _condition_function;
   std::source_location _source_location;
 };
 
 // -----------------------------------------------------------------------------
 /// ensure postcondition to check on scope exit
+// stores the callable inline - see the note on Invariant above
+template<typename ConditionFunction>
+requires std::predicate<ConditionFunction>
 class Ensure {
  public:
   Ensure() = delete;
 
-  explicit Ensure(std::function<bool()> condition_function,
+  explicit Ensure(ConditionFunction condition_function,
          [[maybe_unused]] const std::source_location &source_location =
           std::source_location::current())
   : _uncaught_exceptions(std::uncaught_exceptions()),
@@ -219,17 +215,7 @@ class Ensure {
   ~Ensure() {
     if (!_condition_function()) [[unlikely]] {
       try {
-        const std::string message =
-          format("ERROR: {}: ensure condition failed on exit\n",
-                 format_source_location(_source_location));
-          std::shared_ptr<Record> record{make_shared_init_list<Record>({
-            {"category", "contract"},
-            {"subcategory", "ensure"},
-            {"message", message}
-          })};
-          record->merge(source_location_to_record(_source_location));
-          sink::g_sink_manager.write_record(record);
-          throw contract_violation{message};
+        fail_contract("ensure"sv, "ensure condition failed on exit"sv, _source_location);
       } catch(...) {
         if (std::uncaught_exceptions() == _uncaught_exceptions) {
           throw;   // safe to rethrow
@@ -242,7 +228,7 @@ class Ensure {
 
  private:
   int _uncaught_exceptions;
-  std::function<bool()> _condition_function;
+  ConditionFunction _condition_function;
   std::source_location _source_location;
 };
 
@@ -27,7 +27,8 @@
 #error C++20 or newer support required to use this library.
 #endif
 
-#include <memory>
+#include <concepts>
+#include <ostream>
 #include <utility>
 
 #include <gioppler/sink.hpp>
@@ -36,62 +37,101 @@
 namespace gioppler {
 
 // -----------------------------------------------------------------------------
-struct CounterData {
-  virtual ~CounterData() = default;
-  virtual std::unique_ptr<CounterData> operator+=(std::unique_ptr<CounterData> rhs) = 0;
-
-  friend std::unique_ptr<CounterData> operator+(std::unique_ptr<CounterData> lhs, std::unique_ptr<CounterData> rhs) {
-    *lhs += std::move(rhs);
+/// CRTP helper deriving the value-returning operators from the compound ones
+// platform counter data types define +=, -=, and *= and inherit +, -, *
+// everything is a plain value type, so counter arithmetic inlines fully -
+// no virtual dispatch and no heap allocation per sample
+template<typename Data>
+struct CounterDataOps {
+  friend Data operator+(Data lhs, const Data& rhs) {
+    lhs += rhs;
     return lhs;
   }
 
-  virtual std::unique_ptr<Record> get_record() = 0;
-};
-
-// -----------------------------------------------------------------------------
-class Counter {
-
-  void enter_child() {
-
+  friend Data operator-(Data lhs, const Data& rhs) {
+    lhs -= rhs;
+    return lhs;
   }
 
-  void exit_child() {
-
+  friend Data operator*(Data lhs, const double factor) {
+    lhs *= factor;
+    return lhs;
   }
-
-  virtual std::unique_ptr<CounterData> get_data() = 0;
-  virtual ~Counter() = 0;
 };
 
 // -----------------------------------------------------------------------------
-std::unordered_map<std::string, uint64_t> counter_value;
+/// static interface for a platform's counter snapshot data
+// a value type with saturating-free integer arithmetic, as modeled by
+// linux::LinuxEventsData: += and -= to accumulate and take deltas,
+// *= to undo sampling ratios, and the CSV reporting hooks
+template<typename Data>
+concept CounterData =
+    std::default_initializable<Data> &&
+    std::copyable<Data> &&
+    requires(Data data, const Data& other, std::ostream& os) {
+      { data += other } -> std::same_as<Data&>;
+      { data -= other } -> std::same_as<Data&>;
+      { data *= 1.0 }   -> std::same_as<Data&>;
+      { Data::write_header(os) };
+      { data.write_data(os) };
+    };
 
 // -----------------------------------------------------------------------------
-class CounterFactory {
- public:
-  CounterFactory() = default;
-  virtual ~CounterFactory() = default;
-
- protected:
-  virtual std::vector<uint64_t> get_counter_values() = 0;
-  virtual std::vector<std::string> get_counter_names() = 0;
-  virtual std::vector<double> get_counter_scales() = 0;
-
- private:
+/// static interface for a platform's counter event source
+// get_snapshot() must compile down to the platform read (a group read
+// syscall or rdpmc on Linux) plus a struct copy, nothing more
+template<typename Events>
+concept CounterEvents =
+    std::default_initializable<Events> &&
+    requires(Events events) {
+      { events.enable_events() };
+      { events.get_snapshot() } -> CounterData;
+    };
 
+// -----------------------------------------------------------------------------
+/// no-op counter implementation for platforms without native support
+// keeps the rest of the library compiling; all calls fold to nothing
+struct NullEventsData : public CounterDataOps<NullEventsData> {
+  static void write_header(std::ostream&) { }
+  void write_data(std::ostream&) { }
+  NullEventsData& operator+=(const NullEventsData&) { return *this; }
+  NullEventsData& operator-=(const NullEventsData&) { return *this; }
+  NullEventsData& operator*=(const double) { return *this; }
 };
 
-// -----------------------------------------------------------------------------
-// defined in platform file:
-// static inline thread_local std::unique_ptr<CounterFactory> g_counter_factory;
+class NullEvents {
+ public:
+  void enable_events() { }
+  NullEventsData get_snapshot() { return NullEventsData{}; }
+};
 
 // -----------------------------------------------------------------------------
 }   // namespace gioppler
 
 // -----------------------------------------------------------------------------
+// the platform counter type is selected by #if, not by a virtual factory,
+// so counter sampling inlines fully into the profiling call sites
 #if defined(GIOPPLER_PLATFORM_LINUX)
 #include "gioppler/linux/counter.hpp"
+
+namespace gioppler {
+using PlatformEvents     = linux::LinuxEvents;
+using PlatformEventsData = linux::LinuxEventsData;
+}   // namespace gioppler
+#else
+namespace gioppler {
+using PlatformEvents     = NullEvents;
+using PlatformEventsData = NullEventsData;
+}   // namespace gioppler
 #endif
 
+// -----------------------------------------------------------------------------
+namespace gioppler {
+static_assert(CounterData<PlatformEventsData>,
+              "platform counter data must satisfy the CounterData interface");
+static_assert(CounterEvents<PlatformEvents>,
+              "platform counter events must satisfy the CounterEvents interface");
+}   // namespace gioppler
+
 // -----------------------------------------------------------------------------
 #endif // defined GIOPPLER_COUNTER_HPP
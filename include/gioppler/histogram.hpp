@@ -28,10 +28,14 @@
 #endif
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <ios>
+#include <span>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "gioppler/contract.hpp"
@@ -59,15 +63,24 @@ using observation_t = uint64_t;
 class Bucket
 {
 public:
+  // an empty bucket carries no observations, so there is nothing to validate;
+  // only used to reserve storage slots, never visible through the histogram
   Bucket()
     : _observation_min{}, _observation_span{}, _count{}
+  { }
+
+  explicit Bucket(const observation_t observation)
+    : _observation_min{observation}, _observation_span{}, _count{1}
   {
     contract::confirm(invariant());
   }
 
-  explicit Bucket(const observation_t observation)
-    : _observation_min{observation}, _observation_span{}, _count{1}
+  /// a bucket spanning [min, max] holding count observations
+  // used when merging histograms, where split buckets are reassembled
+  Bucket(const observation_t min, const observation_t max, const rank_t count)
+    : _observation_min{min}, _observation_span{max-min}, _count{count}
   {
+    assert(max >= min);
     contract::confirm(invariant());
   }
 
@@ -144,40 +157,163 @@ operator <<(std::ostream& os, const Bucket& bucket) {
   return bucket.write(os);
 }
 
+// -----------------------------------------------------------------------------
+/// heap-allocated bucket storage with a fixed budget
+// the vector is reserved up front and never grows past max_buckets
+// Note: this is an internal class intended to be used only through BasicHistogram
+class DynamicBuckets
+{
+public:
+  static constexpr rank_t max_buckets = 256;
+
+  DynamicBuckets() {
+    _buckets.reserve(max_buckets);
+  }
+
+  std::size_t size() const      { return _buckets.size(); }
+  Bucket* begin()               { return _buckets.data(); }
+  Bucket* end()                 { return _buckets.data()+_buckets.size(); }
+  const Bucket* begin() const   { return _buckets.data(); }
+  const Bucket* end() const     { return _buckets.data()+_buckets.size(); }
+
+  void append(const Bucket& bucket) {
+    _buckets.emplace_back(bucket);
+  }
+
+  /// drop the trailing buckets after an in-place merge
+  void truncate(const std::size_t size) {
+    assert(size <= _buckets.size());
+    _buckets.erase(_buckets.begin()+static_cast<std::ptrdiff_t>(size), _buckets.end());
+  }
+
+private:
+  std::vector<Bucket> _buckets;
+};
+
+// -----------------------------------------------------------------------------
+/// inline bucket storage with a compile-time budget - never allocates
+// intended for per-call-site latency tracking where the histogram is embedded
+// in another object and updates must stay allocation-free
+// Note: this is an internal class intended to be used only through BasicHistogram
+template<std::size_t N>
+class InlineBuckets
+{
+public:
+  static_assert(N >= 4, "need at least four buckets to compute quartiles");
+  static_assert(N <= UINT32_MAX, "bucket budget must fit in rank_t");
+  static constexpr rank_t max_buckets = N;
+
+  std::size_t size() const      { return _size; }
+  Bucket* begin()               { return _buckets.data(); }
+  Bucket* end()                 { return _buckets.data()+_size; }
+  const Bucket* begin() const   { return _buckets.data(); }
+  const Bucket* end() const     { return _buckets.data()+_size; }
+
+  void append(const Bucket& bucket) {
+    assert(_size < N);
+    _buckets[_size++] = bucket;
+  }
+
+  /// drop the trailing buckets after an in-place merge
+  void truncate(const std::size_t size) {
+    assert(size <= _size);
+    _size = size;
+  }
+
+private:
+  std::array<Bucket, N> _buckets{};
+  std::size_t _size = 0;
+};
+
 // -----------------------------------------------------------------------------
 /// histogram of uint64 values
 // provides robust statistics computed using quantiles
-// uses a vector to store the buckets with periodic compacting
-// the vector is not resized once initially created
+// bucket storage is a policy: heap-allocated (Histogram) or inline (FixedHistogram)
+// the storage is not resized once initially created
 // number of buckets can handle millions of observations
 // buckets have varying widths and are only allocated as needed
 // compacting aims the level the number of observations per bucket
 // https://en.wikipedia.org/wiki/Histogram
 // https://en.wikipedia.org/wiki/Robust_statistics
 // https://en.wikipedia.org/wiki/Quantile
-class Histogram
+template<typename BucketStorage>
+class BasicHistogram
 {
 public:
-  Histogram()
+  BasicHistogram()
     : _observations{}, _compacted(true)
   {
-    _buckets.reserve(max_buckets);
     assert(invariant());
   }
 
+  /// record one observation - the hot path
+  // one bucket write plus a counter increment; compaction is amortized
+  // over max_buckets insertions and the full invariant is only checked there
   void add_observation(const observation_t observation)
   {
-    assert(invariant());
-    _buckets.emplace_back(Bucket(observation));
+    _buckets.append(Bucket(observation));
     ++_observations;
     _compacted = false;
-    assert(invariant());
 
     if (_buckets.size() >= max_buckets) {
       compact_buckets();
     }
   }
 
+  /// merge another histogram's buckets into this one
+  // supports one histogram per thread per metric: updates stay contention
+  // free and the shards are folded together at report time
+  // overlapping buckets are split at their boundaries with the counts
+  // apportioned by overlap, so merging two compacted histograms does not
+  // collapse their (heavily overlapping) buckets into one giant bucket;
+  // the merged result is re-compacted down to the target bucket budget
+  BasicHistogram& operator +=(const BasicHistogram& rhs)
+  {
+    contract::argument(this != &rhs);
+    if (!rhs._observations)   return *this;
+    compact_buckets();
+    rhs.compact_buckets();
+
+    const std::vector<Piece> pieces =
+        merge_pieces(Cursor{_buckets.begin(), _buckets.end()},
+                     Cursor{rhs._buckets.begin(), rhs._buckets.end()});
+    _observations += rhs._observations;
+
+    // integerize the fractional piece counts, conserving the total,
+    // and re-compact down to the target bucket budget as we go
+    const rank_t target_bucket_size = 1+round_div(_observations, max_buckets);
+    _buckets.truncate(0);
+    double cumulative = 0.0;
+    rank_t emitted    = 0;
+
+    for (std::size_t next = 0; next < pieces.size(); ++next) {
+      cumulative += pieces[next]._count;
+      if (next+1 == pieces.size()) {
+        cumulative = _observations;   // pin the total against rounding drift
+      }
+      const rank_t count = static_cast<rank_t>(std::llround(cumulative))-emitted;
+      if (!count)   continue;
+      emitted += count;
+      const Bucket piece_bucket{pieces[next]._low, pieces[next]._high, count};
+      if (_buckets.size() &&
+          ((_buckets.end()-1)->get_count() < target_bucket_size ||
+           _buckets.size() >= max_buckets-1)) {
+        *(_buckets.end()-1) += piece_bucket;
+      } else {
+        _buckets.append(piece_bucket);
+      }
+    }
+
+    _compacted = true;
+    assert(invariant());
+    return *this;
+  }
+
+  friend BasicHistogram operator +(BasicHistogram lhs, const BasicHistogram& rhs) {
+    lhs += rhs;
+    return lhs;
+  }
+
   rank_t get_count() const {
     return _observations;
   }
@@ -375,8 +511,94 @@ public:
 private:
   rank_t _observations;                       // count of observations
   mutable bool _compacted;
-  mutable std::vector<Bucket> _buckets;
-  static constexpr rank_t max_buckets = 256;
+  mutable BucketStorage _buckets;
+  static constexpr rank_t max_buckets = BucketStorage::max_buckets;
+
+  /// one disjoint slice of the bucket ranges produced while merging
+  // counts are fractional here because splitting a bucket apportions its
+  // count by overlap; they are rounded back to integers afterwards
+  struct Piece {
+    observation_t _low;
+    observation_t _high;
+    double        _count;
+  };
+
+  /// walking cursor over one side of a merge
+  // tracks the still-unconsumed remainder of the current bucket
+  struct Cursor {
+    const Bucket* _next;
+    const Bucket* _end;
+    observation_t _low{};
+    observation_t _high{};
+    double        _count{};
+    bool          _active = false;
+
+    Cursor(const Bucket* const begin, const Bucket* const end)
+      : _next{begin}, _end{end}
+    {
+      advance();
+    }
+
+    void advance() {
+      _active = (_next != _end);
+      if (_active) {
+        _low   = _next->get_min();
+        _high  = _next->get_max();
+        _count = _next->get_count();
+        ++_next;
+      }
+    }
+
+    /// consume [_low, upto], returning the apportioned count
+    // models the observations as evenly spread over the bucket range
+    double take(const observation_t upto) {
+      assert(upto >= _low);
+      if (upto >= _high) {
+        const double taken = _count;
+        advance();
+        return taken;
+      }
+      const double width = static_cast<double>(_high-_low)+1.0;
+      const double taken = _count * ((static_cast<double>(upto-_low)+1.0) / width);
+      _count -= taken;
+      _low = upto+1;
+      return taken;
+    }
+  };
+
+  /// merge two sorted, internally disjoint bucket lists into disjoint pieces
+  // classic interval sweep: at most one bucket from each side is ever
+  // active, so overlaps are resolved pairwise by splitting at boundaries
+  static std::vector<Piece> merge_pieces(Cursor a, Cursor b)
+  {
+    std::vector<Piece> pieces;
+    while (a._active && b._active) {
+      Cursor& lead  = (a._low <= b._low) ? a : b;
+      Cursor& trail = (a._low <= b._low) ? b : a;
+
+      if (lead._high < trail._low) {          // fully before: emit as-is
+        pieces.emplace_back(Piece{lead._low, lead._high, lead._count});
+        lead.advance();
+      } else if (lead._low < trail._low) {    // emit the non-overlapping prefix
+        const observation_t low   = lead._low;
+        const observation_t split = trail._low-1;
+        const double        count = lead.take(split);
+        pieces.emplace_back(Piece{low, split, count});
+      } else {                                // aligned: combine the common range
+        const observation_t low   = lead._low;
+        const observation_t split = std::min(lead._high, trail._high);
+        const double        count = lead.take(split)+trail.take(split);
+        pieces.emplace_back(Piece{low, split, count});
+      }
+    }
+    for (Cursor* const rest : {&a, &b}) {
+      while (rest->_active) {
+        pieces.emplace_back(Piece{rest->_low, rest->_high, rest->_count});
+        rest->advance();
+      }
+    }
+    return pieces;
+  }
 
   // https://stackoverflow.com/questions/2422712/rounding-integer-division-instead-of-truncating
   static uint64_t round_div(const uint64_t dividend, const uint64_t divisor)
@@ -403,17 +625,21 @@ private:
   observation_t get_min() const
   {
     compact_buckets();
-    return _buckets.size() ? _buckets.front().get_rank(1) : 0;
+    return _buckets.size() ? _buckets.begin()->get_rank(1) : 0;
   }
 
   observation_t get_max() const
   {
     compact_buckets();
-    return _buckets.size() ? _buckets.back().get_rank(_buckets.back().get_count()) : 0;
+    if (!_buckets.size())   return 0;
+    const Bucket& last_bucket = *(_buckets.end()-1);
+    return last_bucket.get_rank(last_bucket.get_count());
   }
 
   /// ensure we have room to add another bucket
   // makes sure the buckets are sorted correctly and non-overlapping
+  // merges in place with a read and a write cursor, so no storage is
+  // allocated or freed - required for the inline storage policy
   void compact_buckets() const
   {
     if (_compacted)   return;
@@ -422,20 +648,20 @@ private:
                       [](const Bucket& l, const Bucket& r) { return (l.get_min() < r.get_min()); });
 
     const rank_t target_bucket_size = 1+round_div(_observations, max_buckets);
-    Bucket* p_last_bucket = nullptr;
-
-    for (auto bucket_it = std::begin(_buckets); bucket_it != std::end(_buckets); ) {
-      if (p_last_bucket &&
-          (p_last_bucket->get_count() < target_bucket_size ||
-           bucket_it->is_overlapping(*p_last_bucket))) {
-        *p_last_bucket += *bucket_it;   // merge
-        bucket_it = _buckets.erase(bucket_it);
+    Bucket* const buckets = _buckets.begin();
+    std::size_t merged = 0;   // buckets [0, merged) are final
+
+    for (std::size_t next = 0; next < _buckets.size(); ++next) {
+      if (merged &&
+          (buckets[merged-1].get_count() < target_bucket_size ||
+           buckets[next].is_overlapping(buckets[merged-1]))) {
+        buckets[merged-1] += buckets[next];   // merge
       } else {
-        p_last_bucket = &(*bucket_it);   // assuming iterator may not be a simple pointer
-        ++bucket_it;
+        buckets[merged++] = buckets[next];
       }
     }
 
+    _buckets.truncate(merged);
     _compacted = true;
     assert(invariant());
     assert(_buckets.size() < max_buckets);
@@ -468,7 +694,8 @@ private:
   {
     compact_buckets();
     rank_t high_count = 0;
-    for (auto bucket_it = std::crbegin(_buckets); bucket_it != std::crend(_buckets); ++bucket_it) {
+    for (auto bucket_it = std::make_reverse_iterator(_buckets.end());
+         bucket_it != std::make_reverse_iterator(_buckets.begin()); ++bucket_it) {
       if (bucket_it->get_min() >= threshold) {
         high_count += bucket_it->get_count();   // full bucket
       } else {                                  // partial bucket
@@ -500,11 +727,217 @@ private:
   }
 };
 
+template<typename BucketStorage>
 std::ostream&
-operator<<(std::ostream& os, const Histogram& histogram) {
+operator<<(std::ostream& os, const BasicHistogram<BucketStorage>& histogram) {
   return histogram.write(os);
 }
 
+// -----------------------------------------------------------------------------
+/// the general-purpose histogram - buckets live on the heap
+using Histogram = BasicHistogram<DynamicBuckets>;
+
+/// fixed-capacity histogram - buckets live inline, updates never allocate
+// N is the bucket budget; quantile accuracy degrades gracefully as N shrinks
+template<std::size_t N>
+using FixedHistogram = BasicHistogram<InlineBuckets<N>>;
+
+// -----------------------------------------------------------------------------
+/// streaming quantile estimator using the P-squared algorithm
+// tracks one quantile (e.g. p99) with five markers - a handful of doubles
+// of state per metric, versus the bucket histogram whose storage and
+// compaction costs grow with the observation spread
+// add_observation is a few compares and marker updates, no allocation
+// shares observation_t/rank_t with the histograms so reporting code can
+// treat the two kinds of estimator alike
+// https://www.cse.wustl.edu/~jain/papers/ftp/psqr.htm
+class StreamingQuantile
+{
+public:
+  explicit StreamingQuantile(const double quantile)
+    : _quantile{quantile}, _observations{}
+  {
+    contract::argument(quantile > 0.0 && quantile < 1.0);
+  }
+
+  void add_observation(const observation_t observation)
+  {
+    const double x = static_cast<double>(observation);
+    if (_observations < markers) [[unlikely]] {   // bootstrap on the first five
+      _heights[_observations++] = x;
+      if (_observations == markers) {
+        std::sort(_heights.begin(), _heights.end());
+        for (int i = 0; i < markers; ++i) {
+          _positions[i] = i+1;
+        }
+        _desired    = {1.0, 1.0+2.0*_quantile, 1.0+4.0*_quantile, 3.0+2.0*_quantile, 5.0};
+        _increments = {0.0, _quantile/2.0, _quantile, (1.0+_quantile)/2.0, 1.0};
+      }
+      return;
+    }
+
+    // locate the containing cell, extending the extremes as needed
+    int cell;
+    if (x < _heights[0]) {
+      _heights[0] = x;
+      cell = 0;
+    } else if (x >= _heights[markers-1]) {
+      _heights[markers-1] = x;
+      cell = markers-2;
+    } else {
+      cell = 0;
+      while (x >= _heights[cell+1]) {
+        ++cell;
+      }
+    }
+
+    for (int i = cell+1; i < markers; ++i) {
+      ++_positions[i];
+    }
+    for (int i = 0; i < markers; ++i) {
+      _desired[i] += _increments[i];
+    }
+    ++_observations;
+
+    // nudge the three middle markers toward their desired positions
+    for (int i = 1; i < markers-1; ++i) {
+      const double delta = _desired[i]-_positions[i];
+      if ((delta >= 1.0 && _positions[i+1]-_positions[i] > 1.0) ||
+          (delta <= -1.0 && _positions[i-1]-_positions[i] < -1.0)) {
+        const double direction = (delta >= 1.0) ? 1.0 : -1.0;
+        const double parabolic = interpolate_parabolic(i, direction);
+        if (_heights[i-1] < parabolic && parabolic < _heights[i+1]) {
+          _heights[i] = parabolic;
+        } else {
+          _heights[i] = interpolate_linear(i, direction);
+        }
+        _positions[i] += direction;
+      }
+    }
+  }
+
+  rank_t get_count() const {
+    return _observations;
+  }
+
+  /// current estimate for the tracked quantile
+  observation_t get_quantile() const
+  {
+    if (!_observations)   return 0;
+    if (_observations < markers) {   // too few observations: use the exact rank
+      std::array<double, markers> sorted = _heights;
+      std::sort(sorted.begin(), sorted.begin()+_observations);
+      const auto rank = static_cast<std::size_t>(std::llround(_quantile*(_observations-1)));
+      return static_cast<observation_t>(std::llround(sorted[rank]));
+    }
+    return static_cast<observation_t>(std::llround(_heights[markers/2]));
+  }
+
+  observation_t get_min() const
+  {
+    if (!_observations)   return 0;
+    if (_observations < markers) {
+      return static_cast<observation_t>(std::llround(
+          *std::min_element(_heights.begin(), _heights.begin()+_observations)));
+    }
+    return static_cast<observation_t>(std::llround(_heights[0]));
+  }
+
+  observation_t get_max() const
+  {
+    if (!_observations)   return 0;
+    if (_observations < markers) {
+      return static_cast<observation_t>(std::llround(
+          *std::max_element(_heights.begin(), _heights.begin()+_observations)));
+    }
+    return static_cast<observation_t>(std::llround(_heights[markers-1]));
+  }
+
+  std::ostream& write(std::ostream& os) const
+  {
+    os << '{' << "quantile:" << _quantile
+       << ',' << "estimate:" << get_quantile()
+       << ',' << "count:" << get_count()
+       << '}';
+    return os;
+  }
+
+private:
+  static constexpr int markers = 5;
+
+  double _quantile;                           // the quantile being tracked, in (0,1)
+  rank_t _observations;                       // count of observations
+  std::array<double, markers> _heights{};     // marker heights (value estimates)
+  std::array<double, markers> _positions{};   // actual marker positions
+  std::array<double, markers> _desired{};     // desired marker positions
+  std::array<double, markers> _increments{};  // per-observation desired increments
+
+  // the P-squared piecewise-parabolic prediction for marker i moved by d
+  double interpolate_parabolic(const int i, const double d) const
+  {
+    const double np = _positions[i+1], n0 = _positions[i], nm = _positions[i-1];
+    const double qp = _heights[i+1],   q0 = _heights[i],   qm = _heights[i-1];
+    return q0 + d/(np-nm) * ((n0-nm+d)*(qp-q0)/(np-n0) + (np-n0-d)*(q0-qm)/(n0-nm));
+  }
+
+  // fallback when the parabolic prediction is not monotone
+  double interpolate_linear(const int i, const double d) const
+  {
+    const int j = i+static_cast<int>(d);
+    return _heights[i] + d*(_heights[j]-_heights[i])/(_positions[j]-_positions[i]);
+  }
+};
+
+std::ostream&
+operator <<(std::ostream& os, const StreamingQuantile& quantile) {
+  return quantile.write(os);
+}
+
+// -----------------------------------------------------------------------------
+/// fold a set of per-thread histograms into one, in parallel
+// report time can face 40+ thread shards for hundreds of metrics; folding
+// them serially at shutdown adds up - this is a two-level tree reduction:
+// one worker folds each contiguous chunk, then the partials are combined
+// the input histograms are consumed - the shards are dead after reporting
+template<typename BucketStorage>
+BasicHistogram<BucketStorage>
+reduce_histograms(const std::span<BasicHistogram<BucketStorage>> histograms)
+{
+  using Histogram_t = BasicHistogram<BucketStorage>;
+  Histogram_t result{};
+  if (histograms.empty())   return result;
+
+  // fold [first, last) serially into its first element
+  const auto fold_chunk = [](Histogram_t* first, Histogram_t* const last) {
+    for (Histogram_t* shard = first+1; shard < last; ++shard) {
+      *first += *shard;
+    }
+  };
+
+  const std::size_t workers_max =
+      std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  const std::size_t chunks     = std::min(histograms.size(), workers_max);
+  const std::size_t chunk_size = (histograms.size()+chunks-1) / chunks;
+  Histogram_t* const shards_end = histograms.data()+histograms.size();
+
+  std::vector<Histogram_t*> chunk_heads;
+  chunk_heads.reserve(chunks);
+
+  {   // jthread joins on scope exit, before the partials are combined
+    std::vector<std::jthread> workers;
+    workers.reserve(chunks);
+    for (Histogram_t* first = histograms.data(); first < shards_end; first += chunk_size) {
+      chunk_heads.emplace_back(first);
+      workers.emplace_back(fold_chunk, first, std::min(first+chunk_size, shards_end));
+    }
+  }
+
+  for (Histogram_t* const chunk_head : chunk_heads) {
+    result += *chunk_head;
+  }
+  return result;
+}
+
 // -----------------------------------------------------------------------------
 } // namespace gioppler::histogram
 
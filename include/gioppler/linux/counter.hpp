@@ -27,6 +27,17 @@
 #error C++20 or newer support required to use this library.
 #endif
 
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
 #include "gioppler/config.hpp"
 
 // -----------------------------------------------------------------------------
@@ -37,114 +48,246 @@
 #include <linux/hw_breakpoint.h>          // Definition of HW_* constants
 #include <sys/syscall.h>                  // Definition of SYS_* constants
 #include <sys/ioctl.h>
+#include <sys/mman.h>                     // mmap of perf_event_mmap_page
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>                    // _rdpmc
+#endif
+
 // -----------------------------------------------------------------------------
 namespace gioppler::linux
 {
 
 // ---------------------------------------------------------------------------
+/// a group of perf events read together with a single read() syscall
+// The group leader is opened with PERF_FORMAT_GROUP, so one read returns the
+// values of every member at once (plus the enabled/running times used to
+// scale for counter multiplexing), instead of one syscall per counter.
+// https://man7.org/linux/man-pages/man2/perf_event_open.2.html
 class LinuxEvent {
  public:
-  LinuxEvent() : _num_events(0) {}
+  /// describes one event within the group
+  struct EventSpec {
+    std::string_view name;
+    uint32_t event_type;
+    uint64_t event;
+  };
 
-  LinuxEvent(const std::string_view name, const uint32_t event_type, const uint64_t event) {
-    _num_events = 1;
-    _name1 = name;
-    _fd1 = open_event(name, event_type, event, -1);
+  static constexpr size_t max_group_events = 16;
+
+  LinuxEvent() = default;
+
+  explicit LinuxEvent(std::initializer_list<EventSpec> events) {
+    assert(events.size() >= 1 && events.size() <= max_group_events);
+    for (const EventSpec& event_spec : events) {
+      const int group_fd = _fds.empty() ? -1 : _fds.front();
+      const int fd       = open_event(event_spec, group_fd);
+      if (fd == -1) {            // unavailable event: it just reads as zero
+        _slots.push_back(-1);    // the rest of the group keeps working
+        continue;
+      }
+      _slots.push_back(static_cast<int>(_fds.size()));
+      _names.push_back(event_spec.name);
+      _fds.push_back(fd);
+    }
+    map_events();
+    reset_events();
   }
 
-  LinuxEvent(const std::string_view name1, const uint32_t event_type1, const uint64_t event1,
-             const std::string_view name2, const uint32_t event_type2, const uint64_t event2) {
-    _num_events = 2;
-    _name1 = name1;
-    _fd1 = open_event(name1, event_type1, event1, -1);
-    _name2 = name2;
-    _fd2 = open_event(name2, event_type2, event2, _fd1);
+  LinuxEvent(const LinuxEvent&) = delete;
+  LinuxEvent& operator=(const LinuxEvent&) = delete;
 
-    reset_event(name1, _fd1, (_num_events == 1 ? Group::single : Group::leader));
+  LinuxEvent(LinuxEvent&& other) noexcept
+  : _names(std::move(other._names)), _slots(std::move(other._slots)),
+    _fds(std::move(other._fds)), _mmap_pages(std::move(other._mmap_pages)) {
+    other._fds.clear();
+    other._mmap_pages.clear();
   }
 
-  LinuxEvent(const std::string_view name1, const uint32_t event_type1, const uint64_t event1,
-             const std::string_view name2, const uint32_t event_type2, const uint64_t event2,
-             const std::string_view name3, const uint32_t event_type3, const uint64_t event3) {
-    _num_events = 3;
-    _name1 = name1;
-    _fd1 = open_event(name1, event_type1, event1, -1);
-    _name2 = name2;
-    _fd2 = open_event(name2, event_type2, event2, _fd1);
-    _name3 = name3;
-    _fd3 = open_event(name3, event_type3, event3, _fd1);
-
-    reset_event(name1, _fd1, (_num_events == 1 ? Group::single : Group::leader));
+  LinuxEvent& operator=(LinuxEvent&& other) noexcept {
+    if (this != &other) {
+      close_events();
+      _names = std::move(other._names);
+      _slots = std::move(other._slots);
+      _fds = std::move(other._fds);
+      _mmap_pages = std::move(other._mmap_pages);
+      other._fds.clear();
+      other._mmap_pages.clear();
+    }
+    return *this;
   }
 
-  LinuxEvent(const std::string_view name1, const uint32_t event_type1, const uint64_t event1,
-             const std::string_view name2, const uint32_t event_type2, const uint64_t event2,
-             const std::string_view name3, const uint32_t event_type3, const uint64_t event3,
-             const std::string_view name4, const uint32_t event_type4, const uint64_t event4) {
-    _num_events = 4;
-    _name1 = name1;
-    _fd1 = open_event(name1, event_type1, event1, -1);
-    _name2 = name2;
-    _fd2 = open_event(name2, event_type2, event2, _fd1);
-    _name3 = name3;
-    _fd3 = open_event(name3, event_type3, event3, _fd1);
-    _name4 = name4;
-    _fd4 = open_event(name4, event_type4, event4, _fd1);
+  ~LinuxEvent() {
+    close_events();
+  }
 
-    reset_event(name1, _fd1, (_num_events == 1 ? Group::single : Group::leader));
+  [[nodiscard]] size_t get_num_events() const {
+    return _fds.size();
   }
 
-  ~LinuxEvent() {
-    disable_event(_name1, _fd1, (_num_events == 1 ? Group::single : Group::leader));
+  void reset_events() {
+    if (!_fds.empty()) {
+      group_ioctl(PERF_EVENT_IOC_RESET, "reset_events");
+    }
+  }
 
-    switch (_num_events) {
-      case 4: close_event(_name4, _fd4);   /* fall-through */
-      case 3: close_event(_name3, _fd3);   /* fall-through */
-      case 2: close_event(_name2, _fd2);   /* fall-through */
-      case 1: close_event(_name1, _fd1);
+  void enable_events() {
+    if (!_fds.empty()) {
+      group_ioctl(PERF_EVENT_IOC_ENABLE, "enable_events");
     }
   }
 
-  void reset_events() {
-    reset_event(_name1, _fd1, (_num_events == 1 ? Group::single : Group::leader));
+  void disable_events() {
+    if (!_fds.empty()) {
+      group_ioctl(PERF_EVENT_IOC_DISABLE, "disable_events");
+    }
   }
 
-  void enable_events() {
-    enable_event(_name1, _fd1, (_num_events == 1 ? Group::single : Group::leader));
+  /// read every member of the group
+  // values are stored into the output array in the order the events were
+  // declared, scaled to account for performance counter multiplexing;
+  // events that failed to open read as zero
+  // Uses the userspace rdpmc fast path when every member supports it
+  // (tens of nanoseconds, no syscall), otherwise one read() on the leader.
+  void read_events(uint64_t* values) {
+    uint64_t opened_values[max_group_events]{};
+    if (!_fds.empty() && !read_events_rdpmc(opened_values)) {
+      read_events_syscall(opened_values);
+    }
+    for (size_t index = 0; index < _slots.size(); ++index) {
+      values[index] = (_slots[index] == -1) ? 0 : opened_values[_slots[index]];
+    }
   }
 
-  uint64_t read_event1() {
-    assert(_num_events >= 1);
-    return read_event(_name1, _fd1);
+ private:
+  std::vector<std::string_view> _names;   // names of the opened events
+  std::vector<int> _slots;   // declared index -> opened slot, -1 if unavailable
+  std::vector<int> _fds;     // the first fd is the group leader
+  std::vector<perf_event_mmap_page*> _mmap_pages;   // one page per event, or empty
+
+  /// perf events degrade to zero readings instead of killing the process
+  // locked-down hosts (perf_event_paranoid=2, cgroup fd limits) are
+  // an expected environment, so warn once per process and carry on
+  static void warn_failure(const std::string_view what, const std::string_view name) {
+    static std::atomic_flag warned;
+    if (!warned.test_and_set()) {
+      std::cerr << "WARNING: gioppler: perf events unavailable: " << what << ": " << name
+                << ": " << std::strerror(errno) << std::endl;
+    }
   }
 
-  uint64_t read_event2() {
-    assert(_num_events >= 2);
-    return read_event(_name2, _fd2);
+  /// read every member of the group with one syscall on the leader
+  void read_events_syscall(uint64_t* values) {
+    GroupReadData read_data{};
+    const ssize_t bytes_read = read(_fds.front(), &read_data, sizeof(read_data));
+    if (bytes_read == -1) {
+      warn_failure("read_events", _names.front());
+      for (size_t index = 0; index < _fds.size(); ++index) {
+        values[index] = 0;
+      }
+      return;
+    }
+    assert(read_data.nr == _fds.size());
+
+    const double active_pct = read_data.time_enabled
+        ? static_cast<double>(read_data.time_running) / static_cast<double>(read_data.time_enabled)
+        : 1.0;
+    const double scale = (active_pct > 0.0) ? (1.0 / active_pct) : 0.0;
+    for (size_t index = 0; index < _fds.size(); ++index) {
+      values[index] = static_cast<uint64_t>(static_cast<double>(read_data.values[index]) * scale);
+    }
   }
 
-  uint64_t read_event3() {
-    assert(_num_events >= 3);
-    return read_event(_name3, _fd3);
+  /// map one perf_event_mmap_page per event to enable userspace reads
+  // failure to map is not an error; we just keep using the syscall path
+  void map_events() {
+    const long page_size = sysconf(_SC_PAGESIZE);
+    for (const int fd : _fds) {
+      void* page = mmap(nullptr, static_cast<size_t>(page_size), PROT_READ, MAP_SHARED, fd, 0);
+      if (page == MAP_FAILED) {
+        unmap_events();
+        return;
+      }
+      _mmap_pages.push_back(static_cast<perf_event_mmap_page*>(page));
+    }
   }
 
-  uint64_t read_event4() {
-    assert(_num_events >= 4);
-    return read_event(_name4, _fd4);
+  void unmap_events() {
+    const long page_size = sysconf(_SC_PAGESIZE);
+    for (perf_event_mmap_page* page : _mmap_pages) {
+      munmap(page, static_cast<size_t>(page_size));
+    }
+    _mmap_pages.clear();
+  }
+
+  /// read every member of the group in userspace via rdpmc
+  // Returns false when any member lacks rdpmc support (software events,
+  // cap_user_rdpmc disabled) so the caller can fall back to read().
+  bool read_events_rdpmc(uint64_t* values) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (_mmap_pages.empty())   return false;
+    for (size_t index = 0; index < _mmap_pages.size(); ++index) {
+      if (!read_mmap_counter(_mmap_pages[index], values[index])) {
+        return false;
+      }
+    }
+    return true;
+#else
+    (void)values;
+    return false;   // rdpmc is an x86 instruction
+#endif
   }
 
- private:
-  enum class Group { leader, single };
-  int _num_events;
-  std::string_view _name1, _name2, _name3, _name4;
-  int _fd1, _fd2, _fd3, _fd4;
+#if defined(__x86_64__) || defined(__i386__)
+  /// seqlock-protected userspace read of one hardware counter
+  // https://man7.org/linux/man-pages/man2/perf_event_open.2.html (MMAP layout)
+  static bool read_mmap_counter(const perf_event_mmap_page* page, uint64_t& value) {
+    uint64_t count, time_enabled, time_running;
+    uint32_t seq;
+    do {
+      seq = read_once(page->lock);
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      const uint32_t index = read_once(page->index);
+      if (!page->cap_user_rdpmc || index == 0) {
+        return false;   // not countable in userspace; use the syscall path
+      }
+
+      // the counter is pmc_width bits wide; sign-extend before adding the offset
+      int64_t pmc = static_cast<int64_t>(_rdpmc(index-1));
+      const unsigned shift = 64u - page->pmc_width;
+      pmc = (pmc << shift) >> shift;
+      count        = static_cast<uint64_t>(static_cast<int64_t>(page->offset) + pmc);
+      time_enabled = read_once(page->time_enabled);
+      time_running = read_once(page->time_running);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while (read_once(page->lock) != seq || (seq & 1));
+
+    const double active_pct = time_enabled
+        ? static_cast<double>(time_running) / static_cast<double>(time_enabled)
+        : 1.0;
+    value = (active_pct > 0.0)
+        ? static_cast<uint64_t>(static_cast<double>(count) * (1.0 / active_pct))
+        : 0;
+    return true;
+  }
+
+  /// force a fresh load of a field the kernel updates behind our back
+  template<typename T>
+  static T read_once(const T& field) {
+    return *const_cast<const volatile T*>(&field);
+  }
+#endif
 
-  struct ReadData {
-    uint64_t value;         /* The value of the event */
+  /// layout returned by read() on the group leader
+  // PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING
+  struct GroupReadData {
+    uint64_t nr;            /* number of events in the group */
     uint64_t time_enabled;  /* if PERF_FORMAT_TOTAL_TIME_ENABLED */
     uint64_t time_running;  /* if PERF_FORMAT_TOTAL_TIME_RUNNING */
+    uint64_t values[max_group_events];
   };
 
   // measures the calling process/thread on any CPU
@@ -154,77 +297,48 @@ class LinuxEvent {
     return static_cast<int>(syscall(__NR_perf_event_open, hw_event, pid, cpu, group_fd, flags));
   }
 
-  static int open_event(const std::string_view name,
-                        const uint32_t event_type, const uint64_t event, const int group_fd) {
+  static int open_event(const EventSpec& event_spec, const int group_fd) {
     struct perf_event_attr perf_event_attr{
-      .size = sizeof(perf_event_attr);
-      .type = event_type;
-      .config = event;
-      .disabled = 1;
-      .exclude_kernel = 1;
-      .exclude_hv = 1;
-      .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      .type = event_spec.event_type,
+      .size = sizeof(perf_event_attr),
+      .config = event_spec.event,
+      .read_format = PERF_FORMAT_GROUP |
+                     PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+      .disabled = (group_fd == -1),   // only the group leader starts disabled
+      .exclude_kernel = 1,
+      .exclude_hv = 1
     };
 
     const int fd = perf_event_open(&perf_event_attr, 0, -1, group_fd, 0);
     if (fd == -1) {
-      std::cerr << "ERROR: LinuxEvent::open_event: " << name << ": " << std::strerror(errno) << std::endl;
-      std::exit(EXIT_FAILURE);
+      warn_failure("open_event", event_spec.name);
     }
-
     return fd;
   }
 
-  static void reset_event(const std::string_view name, const int fd, const Group group) {
-    const int status = ioctl(fd, PERF_EVENT_IOC_RESET, (group == Group::leader ? PERF_IOC_FLAG_GROUP : 0));
+  /// issue an ioctl against the group through its leader
+  void group_ioctl(const unsigned long request, const std::string_view what) {
+    const int status = ioctl(_fds.front(), request, PERF_IOC_FLAG_GROUP);
     if (status == -1) {
-      std::cerr << "ERROR: LinuxEvent::reset_event: " << name << ": " << std::strerror(errno) << std::endl;
-      std::exit(EXIT_FAILURE);
+      warn_failure(what, _names.front());
     }
   }
 
-  static void disable_event(const std::string_view name, const int fd, const Group group) {
-    const int status = ioctl(fd, PERF_EVENT_IOC_DISABLE, (group == Group::leader ? PERF_IOC_FLAG_GROUP : 0));
-    if (status == -1) {
-      std::cerr << "ERROR: LinuxEvent::disable_event: " << name << ": " << std::strerror(errno) << std::endl;
-      std::exit(EXIT_FAILURE);
-    }
-  }
-
-  static void enable_event(const std::string_view name, const int fd, const Group group) {
-    const int status = ioctl(fd, PERF_EVENT_IOC_ENABLE, (group == Group::leader ? PERF_IOC_FLAG_GROUP : 0));
-    if (status == -1) {
-      std::cerr << "ERROR: LinuxEvent::enable_event: " << name << ": " << std::strerror(errno) << std::endl;
-      std::exit(EXIT_FAILURE);
-    }
-  }
-
-  static void close_event(const std::string_view name, const int fd) {
-    const int status = close(fd);
-    if (status == -1) {
-      std::cerr << "ERROR: LinuxEvent::close_event: " << name << ": " << std::strerror(errno) << std::endl;
-      std::exit(EXIT_FAILURE);
-    }
-  }
-
-  /// read the counter value
-  // the value is scaled to account for performance counter multiplexing
-  static uint64_t read_event(const std::string_view name, const int fd) {
-    ReadData read_data{};
-    const ssize_t bytes_read = read(fd, &read_data, sizeof(read_data));
-    if (bytes_read == -1) {
-      std::cerr << "ERROR: LinuxEvent::read_event: " << name << ": " << std::strerror(errno) << std::endl;
-      std::exit(EXIT_FAILURE);
+  void close_events() {
+    if (_fds.empty())   return;
+    unmap_events();
+    disable_events();
+    for (size_t index = 0; index < _fds.size(); ++index) {
+      if (close(_fds[index]) == -1) {
+        warn_failure("close_events", _names[index]);
+      }
     }
-
-    const double active_pct = static_cast<double>(read_data.time_running) / static_cast<double>(read_data.time_enabled);
-    const uint64_t scaled_counter = static_cast<uint64_t>(static_cast<double>(read_data.value) * (1.0 / active_pct));
-    return scaled_counter;
+    _fds.clear();
   }
 };
 
 // ---------------------------------------------------------------------------
-class LinuxEventsData {
+class LinuxEventsData : public CounterDataOps<LinuxEventsData> {
  public:
   explicit LinuxEventsData() = default;
 
@@ -267,11 +381,6 @@ class LinuxEventsData {
     return *this;
   }
 
-  friend LinuxEventsData operator+(LinuxEventsData lhs, const LinuxEventsData &rhs) {
-    lhs += rhs;
-    return lhs;
-  }
-
   LinuxEventsData &operator-=(const LinuxEventsData &rhs) {
     _fd_sw_cpu_clock -= rhs._fd_sw_cpu_clock;
     _fd_sw_task_clock -= rhs._fd_sw_task_clock;
@@ -293,9 +402,29 @@ class LinuxEventsData {
     return *this;
   }
 
-  friend LinuxEventsData operator-(LinuxEventsData lhs, const LinuxEventsData &rhs) {
-    lhs -= rhs;
-    return lhs;
+  /// scale every counter, e.g. to undo a sampling ratio
+  LinuxEventsData &operator*=(const double factor) {
+    const auto scale = [factor](uint64_t &counter) {
+      counter = static_cast<uint64_t>(static_cast<double>(counter)*factor);
+    };
+    scale(_fd_sw_cpu_clock);
+    scale(_fd_sw_task_clock);
+    scale(_fd_sw_page_faults);
+    scale(_fd_sw_context_switches);
+    scale(_fd_sw_cpu_migrations);
+    scale(_fd_sw_page_faults_min);
+    scale(_fd_sw_page_faults_maj);
+    scale(_fd_sw_alignment_faults);
+    scale(_fd_sw_emulation_faults);
+    scale(_fd_hw_cpu_cycles);
+    scale(_fd_hw_instructions);
+    scale(_fd_hw_stalled_cycles_frontend);
+    scale(_fd_hw_stalled_cycles_backend);
+    scale(_fd_hw_cache_references);
+    scale(_fd_hw_cache_misses);
+    scale(_fd_hw_branch_instructions);
+    scale(_fd_hw_branch_misses);
+    return *this;
   }
 
   double get_cpu_seconds() {
@@ -314,6 +443,14 @@ class LinuxEventsData {
     return static_cast<double>(_fd_hw_cpu_cycles) / static_cast<double>(_fd_hw_instructions);
   }
 
+  uint64_t get_cpu_cycles() {
+    return _fd_hw_cpu_cycles;
+  }
+
+  uint64_t get_cache_misses() {
+    return _fd_hw_cache_misses;
+  }
+
   double get_issue_stall_pct() {
     return static_cast<double>(_fd_hw_stalled_cycles_frontend) / static_cast<double>(_fd_hw_cpu_cycles);
   }
@@ -356,121 +493,128 @@ class LinuxEventsData {
 // ---------------------------------------------------------------------------
 class LinuxEvents {
  public:
-  explicit LinuxEvents() {
-    open_events();
-  }
+  explicit LinuxEvents() = default;   // opening the fds is deferred to first use
 
   ~LinuxEvents() = default;
 
   void enable_events() {
-    _fd_sw_cpu_clock.enable_events();
-    _fd_sw_task_clock.enable_events();
-    _fd_sw_page_faults.enable_events();
-    _fd_sw_context_switches.enable_events();
-    _fd_sw_cpu_migrations.enable_events();
-    _fd_sw_page_faults_min.enable_events();
-    _fd_sw_page_faults_maj.enable_events();
-    _fd_sw_alignment_faults.enable_events();
-    _fd_sw_emulation_faults.enable_events();
-
-    _fd_hw_cpu_cycles_instr_group.enable_events();
-    _fd_hw_cache_references_misses_group.enable_events();
-    _fd_hw_branch_instructions_misses_group.enable_events();
+    check_open_events();
+    _sw_group.enable_events();
+    _hw_cpu_cycles_instr_group.enable_events();
+    _hw_cache_references_misses_group.enable_events();
+    _hw_branch_instructions_misses_group.enable_events();
   }
 
+  /// snapshot all counters with one read() per event group (four total)
   LinuxEventsData get_snapshot() {
+    check_open_events();
     LinuxEventsData data{};
-    data._fd_sw_cpu_clock = _fd_sw_cpu_clock.read_event1();
-    data._fd_sw_task_clock = _fd_sw_task_clock.read_event1();
-    data._fd_sw_page_faults = _fd_sw_page_faults.read_event1();
-    data._fd_sw_context_switches = _fd_sw_context_switches.read_event1();
-    data._fd_sw_cpu_migrations = _fd_sw_cpu_migrations.read_event1();
-    data._fd_sw_page_faults_min = _fd_sw_page_faults_min.read_event1();
-    data._fd_sw_page_faults_maj = _fd_sw_page_faults_maj.read_event1();
-    data._fd_sw_alignment_faults = _fd_sw_alignment_faults.read_event1();
-    data._fd_sw_emulation_faults = _fd_sw_emulation_faults.read_event1();
-
-    data._fd_hw_cpu_cycles = _fd_hw_cpu_cycles_instr_group.read_event1();
-    data._fd_hw_instructions = _fd_hw_cpu_cycles_instr_group.read_event2();
-    data._fd_hw_stalled_cycles_frontend = _fd_hw_cpu_cycles_instr_group.read_event3();
-    data._fd_hw_stalled_cycles_backend = _fd_hw_cpu_cycles_instr_group.read_event4();
-
-    data._fd_hw_cache_references = _fd_hw_cache_references_misses_group.read_event1();
-    data._fd_hw_cache_misses = _fd_hw_cache_references_misses_group.read_event2();
-    data._fd_hw_branch_instructions = _fd_hw_branch_instructions_misses_group.read_event1();
-    data._fd_hw_branch_misses = _fd_hw_branch_instructions_misses_group.read_event2();
+
+    uint64_t sw_values[9];
+    _sw_group.read_events(sw_values);
+    data._fd_sw_cpu_clock         = sw_values[0];
+    data._fd_sw_task_clock        = sw_values[1];
+    data._fd_sw_page_faults       = sw_values[2];
+    data._fd_sw_context_switches  = sw_values[3];
+    data._fd_sw_cpu_migrations    = sw_values[4];
+    data._fd_sw_page_faults_min   = sw_values[5];
+    data._fd_sw_page_faults_maj   = sw_values[6];
+    data._fd_sw_alignment_faults  = sw_values[7];
+    data._fd_sw_emulation_faults  = sw_values[8];
+
+    uint64_t hw_values[4];
+    _hw_cpu_cycles_instr_group.read_events(hw_values);
+    data._fd_hw_cpu_cycles              = hw_values[0];
+    data._fd_hw_instructions            = hw_values[1];
+    data._fd_hw_stalled_cycles_frontend = hw_values[2];
+    data._fd_hw_stalled_cycles_backend  = hw_values[3];
+
+    uint64_t cache_values[2];
+    _hw_cache_references_misses_group.read_events(cache_values);
+    data._fd_hw_cache_references = cache_values[0];
+    data._fd_hw_cache_misses     = cache_values[1];
+
+    uint64_t branch_values[2];
+    _hw_branch_instructions_misses_group.read_events(branch_values);
+    data._fd_hw_branch_instructions = branch_values[0];
+    data._fd_hw_branch_misses       = branch_values[1];
     return data;
   }
 
  private:
-  LinuxEvent _fd_sw_cpu_clock;         // This reports the CPU clock, a high-resolution per-CPU timer.
-  LinuxEvent _fd_sw_task_clock;        // This reports a clock count specific to the task that is running.
-  LinuxEvent _fd_sw_page_faults;       // This reports the number of page faults.
-  LinuxEvent _fd_sw_context_switches;  // This counts context switches.
-  LinuxEvent _fd_sw_cpu_migrations;    // This reports the number of times the process has migrated to a new CPU.
-  LinuxEvent _fd_sw_page_faults_min;   // This counts the number of minor page faults.
-  LinuxEvent
-      _fd_sw_page_faults_maj;   // This counts the number of major page faults. These required disk I/O to handle.
-  LinuxEvent _fd_sw_alignment_faults;  // This counts the number of alignment faults.
-  LinuxEvent _fd_sw_emulation_faults;  // This  counts the number of emulation faults.
+  bool _opened = false;
+
+  // The software events all live on the software PMU, which can always
+  // schedule them together, so they share a single group (one read).
+  LinuxEvent _sw_group;
+
+  // The hardware events stay split across three groups, since real PMUs
+  // do not have enough programmable counters to co-schedule all eight.
 
   // Total cycles.
   // Retired instructions.
   // Stalled cycles during issue.
   // Stalled cycles during retirement.
-  LinuxEvent _fd_hw_cpu_cycles_instr_group;
+  LinuxEvent _hw_cpu_cycles_instr_group;
 
   // Cache accesses.  Usually this indicates Last Level Cache accesses.
   // Cache misses.  Usually this indicates Last Level Cache misses.
-  LinuxEvent _fd_hw_cache_references_misses_group;
+  LinuxEvent _hw_cache_references_misses_group;
 
   // Retired branch instructions.
   // Mispredicted branch instructions.
-  LinuxEvent _fd_hw_branch_instructions_misses_group;
+  LinuxEvent _hw_branch_instructions_misses_group;
+
+  /// open the perf event fds on first use, not at construction
+  // short-lived programs that never take a snapshot skip the 15+ open
+  // syscalls entirely, even in profile builds
+  void check_open_events() {
+    if (_opened) [[likely]]   return;
+    _opened = true;
+    open_events();
+  }
 
   void open_events() {
-    _fd_sw_cpu_clock = LinuxEvent("PERF_COUNT_SW_CPU_CLOCK",
-                                  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK);
-    _fd_sw_task_clock = LinuxEvent("PERF_COUNT_SW_TASK_CLOCK",
-                                   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
-    _fd_sw_page_faults = LinuxEvent("PERF_COUNT_SW_PAGE_FAULTS",
-                                    PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
-    _fd_sw_context_switches = LinuxEvent("PERF_COUNT_SW_CONTEXT_SWITCHES",
-                                         PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
-    _fd_sw_cpu_migrations = LinuxEvent("PERF_COUNT_SW_CPU_MIGRATIONS",
-                                       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS);
-    _fd_sw_page_faults_min = LinuxEvent("PERF_COUNT_SW_PAGE_FAULTS_MIN",
-                                        PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN);
-    _fd_sw_page_faults_maj = LinuxEvent("PERF_COUNT_SW_PAGE_FAULTS_MAJ",
-                                        PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ);
-    _fd_sw_alignment_faults = LinuxEvent("PERF_COUNT_SW_ALIGNMENT_FAULTS",
-                                         PERF_TYPE_SOFTWARE, PERF_COUNT_SW_ALIGNMENT_FAULTS);
-    _fd_sw_emulation_faults = LinuxEvent("PERF_COUNT_SW_EMULATION_FAULTS",
-                                         PERF_TYPE_SOFTWARE, PERF_COUNT_SW_EMULATION_FAULTS);
-
-    _fd_hw_cpu_cycles_instr_group =
-        LinuxEvent("PERF_COUNT_HW_CPU_CYCLES",
-                   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,
-                   "PERF_COUNT_HW_INSTRUCTIONS",
-                   PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
-                   "PERF_COUNT_HW_STALLED_CYCLES_FRONTEND",
-                   PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND,
-                   "PERF_COUNT_HW_STALLED_CYCLES_BACKEND",
-                   PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND);
-
-    _fd_hw_cache_references_misses_group =
-        LinuxEvent("PERF_COUNT_HW_CACHE_REFERENCES",
-                   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES,
-                   "PERF_COUNT_HW_CACHE_MISSES",
-                   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
-    _fd_hw_branch_instructions_misses_group =
-        LinuxEvent("PERF_COUNT_HW_BRANCH_INSTRUCTIONS",
-                   PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
-                   "PERF_COUNT_HW_BRANCH_MISSES",
-                   PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    _sw_group = LinuxEvent{
+        {"PERF_COUNT_SW_CPU_CLOCK",        PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK},
+        {"PERF_COUNT_SW_TASK_CLOCK",       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+        {"PERF_COUNT_SW_PAGE_FAULTS",      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        {"PERF_COUNT_SW_CONTEXT_SWITCHES", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+        {"PERF_COUNT_SW_CPU_MIGRATIONS",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+        {"PERF_COUNT_SW_PAGE_FAULTS_MIN",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN},
+        {"PERF_COUNT_SW_PAGE_FAULTS_MAJ",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ},
+        {"PERF_COUNT_SW_ALIGNMENT_FAULTS", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_ALIGNMENT_FAULTS},
+        {"PERF_COUNT_SW_EMULATION_FAULTS", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_EMULATION_FAULTS}};
+
+    _hw_cpu_cycles_instr_group = LinuxEvent{
+        {"PERF_COUNT_HW_CPU_CYCLES",             PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"PERF_COUNT_HW_INSTRUCTIONS",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"PERF_COUNT_HW_STALLED_CYCLES_FRONTEND",
+         PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND},
+        {"PERF_COUNT_HW_STALLED_CYCLES_BACKEND",
+         PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND}};
+
+    _hw_cache_references_misses_group = LinuxEvent{
+        {"PERF_COUNT_HW_CACHE_REFERENCES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+        {"PERF_COUNT_HW_CACHE_MISSES",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}};
+
+    _hw_branch_instructions_misses_group = LinuxEvent{
+        {"PERF_COUNT_HW_BRANCH_INSTRUCTIONS",
+         PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+        {"PERF_COUNT_HW_BRANCH_MISSES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
   }
 };
 
+// -----------------------------------------------------------------------------
+/// the calling thread's shared event set - one set of fds per thread
+// nested Function scopes reuse these fds instead of reopening 15+ events
+// per scope; the events open lazily on the first snapshot and close when
+// the thread exits, matching the per-thread lifetime of get_thread()
+inline LinuxEvents& get_thread_events() {
+  static thread_local LinuxEvents thread_events{};
+  return thread_events;
+}
+
 // -----------------------------------------------------------------------------
 } // namespace gioppler::linux
 
@@ -0,0 +1,360 @@
+// Copyright (c) 2022 Carlos Reyes
+// This code is licensed under the permissive MIT License (MIT).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+#ifndef GIOPPLER_LINUX_URING_HPP
+#define GIOPPLER_LINUX_URING_HPP
+
+#if __cplusplus < 202002L
+#error C++20 or newer support required to use this library.
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+
+#include "gioppler/config.hpp"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+/// Asynchronous file output through io_uring, a Linux feature.
+#if defined(GIOPPLER_PLATFORM_LINUX)      // Linux kernel; could be GNU or Android
+#include <linux/io_uring.h>               // Definition of IORING_* constants
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>                  // Definition of SYS_* constants
+#include <unistd.h>
+
+// -----------------------------------------------------------------------------
+namespace gioppler::linux
+{
+
+// -----------------------------------------------------------------------------
+/// stream buffer that writes a file through io_uring
+// Raw syscall interface - we only need setup, a write submission, and
+// completion reaping, so there is no need to depend on liburing.
+// Serialized output is copied into one of a fixed pool of buffers; a full
+// buffer (or an explicit flush) is submitted as an IORING_OP_WRITE and the
+// kernel completes it in the background, so the sink's writer thread never
+// blocks in write() when the filesystem stalls. Completions are reaped
+// opportunistically to recycle buffers; the only blocking wait is when all
+// buffers are in flight at once, or in the destructor.
+// Single-threaded by design, like the sinks that use it.
+// https://man7.org/linux/man-pages/man7/io_uring.7.html
+class UringFileBuf final : public std::streambuf {
+ public:
+  UringFileBuf(const UringFileBuf&) = delete;
+  UringFileBuf& operator=(const UringFileBuf&) = delete;
+
+  /// true when the ring and the file were both set up
+  // io_uring can be unavailable (old kernel, seccomp, io_uring_disabled)
+  [[nodiscard]] bool is_open() const {
+    return _ring_fd != -1 && _file_fd != -1;
+  }
+
+  ~UringFileBuf() override {
+    if (is_open()) {
+      submit_current_buffer();
+      while (_buffers_in_flight > 0) {
+        wait_for_completion();
+      }
+    }
+    if (_sq_ring != MAP_FAILED)   ::munmap(_sq_ring, _sq_ring_size);
+    if (_cq_ring != MAP_FAILED)   ::munmap(_cq_ring, _cq_ring_size);
+    if (_sqes != MAP_FAILED)      ::munmap(_sqes, _sqes_size);
+    if (_ring_fd != -1)           ::close(_ring_fd);
+    if (_file_fd != -1)           ::close(_file_fd);
+  }
+
+  explicit UringFileBuf(const std::filesystem::path& path) {
+    io_uring_params params{};
+    _ring_fd = static_cast<int>(::syscall(SYS_io_uring_setup, queue_depth, &params));
+    if (_ring_fd == -1)   return;   // caller falls back to a plain stream
+
+    _sq_ring_size = params.sq_off.array+params.sq_entries*sizeof(uint32_t);
+    _cq_ring_size = params.cq_off.cqes+params.cq_entries*sizeof(io_uring_cqe);
+    _sqes_size    = params.sq_entries*sizeof(io_uring_sqe);
+
+    _sq_ring = ::mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    _cq_ring = ::mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+    _sqes    = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (_sq_ring == MAP_FAILED || _cq_ring == MAP_FAILED || _sqes == MAP_FAILED) {
+      ::close(_ring_fd);
+      _ring_fd = -1;
+      return;
+    }
+
+    const auto sq_base = static_cast<std::byte*>(_sq_ring);
+    _sq_head      = ring_field(sq_base, params.sq_off.head);
+    _sq_tail      = ring_field(sq_base, params.sq_off.tail);
+    _sq_ring_mask = *reinterpret_cast<uint32_t*>(sq_base+params.sq_off.ring_mask);
+    _sq_array     = reinterpret_cast<uint32_t*>(sq_base+params.sq_off.array);
+
+    const auto cq_base = static_cast<std::byte*>(_cq_ring);
+    _cq_head      = ring_field(cq_base, params.cq_off.head);
+    _cq_tail      = ring_field(cq_base, params.cq_off.tail);
+    _cq_ring_mask = *reinterpret_cast<uint32_t*>(cq_base+params.cq_off.ring_mask);
+    _cqes         = reinterpret_cast<io_uring_cqe*>(cq_base+params.cq_off.cqes);
+
+    _file_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_file_fd == -1) {
+      std::cerr << "ERROR: UringFileBuf: " << path << ": " << std::strerror(errno) << std::endl;
+      return;
+    }
+
+    for (Buffer& buffer : _buffers) {
+      buffer._storage = std::make_unique<char[]>(buffer_size);
+    }
+    use_buffer(0);
+  }
+
+ protected:
+  /// the put area is full - submit it and start filling the next buffer
+  int_type overflow(const int_type character) override {
+    submit_current_buffer();
+    if (!traits_type::eq_int_type(character, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(character);
+      pbump(1);
+    }
+    return traits_type::not_eof(character);
+  }
+
+  /// bulk copy into the put area, submitting full buffers along the way
+  std::streamsize xsputn(const char* data, const std::streamsize size) override {
+    std::streamsize remaining = size;
+    while (remaining > 0) {
+      std::streamsize room = epptr()-pptr();
+      if (room == 0) {
+        submit_current_buffer();
+        room = epptr()-pptr();
+      }
+      const std::streamsize step = std::min(remaining, room);
+      std::memcpy(pptr(), data, static_cast<size_t>(step));
+      pbump(static_cast<int>(step));
+      data      += step;
+      remaining -= step;
+    }
+    return size;
+  }
+
+  /// explicit flush - hand whatever has accumulated to the kernel
+  int sync() override {
+    submit_current_buffer();
+    return 0;
+  }
+
+ private:
+  /// enough buffers to ride out multi-second filesystem stalls
+  static constexpr size_t buffer_count = 8;
+  static constexpr size_t buffer_size  = 256*1024;
+  static constexpr unsigned queue_depth = 16;   // >= buffer_count submissions
+
+  struct Buffer {
+    std::unique_ptr<char[]> _storage;
+    size_t _submitted = 0;     // offset into the storage of the pending write
+    size_t _length = 0;        // bytes still to be written from this buffer
+    uint64_t _file_offset = 0; // where in the file they land
+    bool _in_flight = false;
+  };
+
+  static std::atomic<uint32_t>* ring_field(std::byte* base, const uint32_t offset) {
+    return reinterpret_cast<std::atomic<uint32_t>*>(base+offset);
+  }
+
+  /// point the put area at the given pool buffer
+  void use_buffer(const size_t index) {
+    _current_buffer = index;
+    char* storage = _buffers[index]._storage.get();
+    setp(storage, storage+buffer_size);
+  }
+
+  /// submit the filled part of the current buffer and move to a free one
+  void submit_current_buffer() {
+    Buffer& buffer = _buffers[_current_buffer];
+    const size_t length = static_cast<size_t>(pptr()-pbase());
+    if (length == 0)   return;
+
+    buffer._submitted   = 0;
+    buffer._length      = length;
+    buffer._file_offset = _file_offset;
+    buffer._in_flight   = true;
+    _file_offset += length;
+    ++_buffers_in_flight;
+    submit_write(_current_buffer, buffer._storage.get(), length, buffer._file_offset);
+
+    reap_completions();
+    while (_buffers_in_flight == buffer_count) {   // every buffer busy - must wait
+      wait_for_completion();
+    }
+    for (size_t index = 0; index < buffer_count; ++index) {
+      if (!_buffers[index]._in_flight) {
+        use_buffer(index);
+        return;
+      }
+    }
+  }
+
+  /// place one write on the submission queue and tell the kernel
+  void submit_write(const size_t buffer_index, const char* data,
+                    const size_t length, const uint64_t file_offset) {
+    const uint32_t tail = _sq_tail->load(std::memory_order_relaxed);
+    const uint32_t index = tail & _sq_ring_mask;
+
+    io_uring_sqe& sqe = _sqes_array()[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode    = IORING_OP_WRITE;
+    sqe.fd        = _file_fd;
+    sqe.addr      = reinterpret_cast<uint64_t>(data);
+    sqe.len       = static_cast<uint32_t>(length);
+    sqe.off       = file_offset;
+    sqe.user_data = buffer_index;
+
+    _sq_array[index] = index;
+    _sq_tail->store(tail+1, std::memory_order_release);
+    if (::syscall(SYS_io_uring_enter, _ring_fd, 1, 0, 0, nullptr, 0) == -1) {
+      report_error("io_uring_enter");
+    }
+  }
+
+  /// recycle the buffers of any writes the kernel has finished
+  void reap_completions() {
+    uint32_t head = _cq_head->load(std::memory_order_relaxed);
+    const uint32_t tail = _cq_tail->load(std::memory_order_acquire);
+    while (head != tail) {
+      const io_uring_cqe& cqe = _cqes[head & _cq_ring_mask];
+      handle_completion(cqe);
+      ++head;
+    }
+    _cq_head->store(head, std::memory_order_release);
+  }
+
+  /// block until at least one write finishes, then reap
+  void wait_for_completion() {
+    while (::syscall(SYS_io_uring_enter, _ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) == -1) {
+      if (errno == EINTR)   continue;   // a signal landed during the wait - not an error
+      // genuinely fatal - the accounting reset keeps the destructor from
+      // spinning forever, at the cost of abandoning the in-flight writes
+      report_error("io_uring_enter(GETEVENTS)");
+      _buffers_in_flight = 0;
+      for (Buffer& buffer : _buffers) {
+        buffer._in_flight = false;
+      }
+      return;
+    }
+    reap_completions();
+  }
+
+  void handle_completion(const io_uring_cqe& cqe) {
+    Buffer& buffer = _buffers[cqe.user_data];
+    if (cqe.res < 0) {
+      errno = -cqe.res;
+      report_error("write");
+    } else if (static_cast<size_t>(cqe.res) < buffer._length) {
+      // short write - resubmit the tail end; keeps the buffer in flight
+      const size_t written = static_cast<size_t>(cqe.res);
+      buffer._submitted   += written;
+      buffer._length      -= written;
+      buffer._file_offset += written;
+      submit_write(cqe.user_data, buffer._storage.get()+buffer._submitted,
+                   buffer._length, buffer._file_offset);
+      return;
+    }
+    buffer._in_flight = false;
+    --_buffers_in_flight;
+  }
+
+  void report_error(const char* operation) const {
+    std::cerr << "ERROR: UringFileBuf: " << operation << ": " << std::strerror(errno) << std::endl;
+  }
+
+  io_uring_sqe* _sqes_array() const {
+    return static_cast<io_uring_sqe*>(_sqes);
+  }
+
+  int _ring_fd = -1;
+  int _file_fd = -1;
+  void* _sq_ring = MAP_FAILED;
+  void* _cq_ring = MAP_FAILED;
+  void* _sqes    = MAP_FAILED;
+  size_t _sq_ring_size = 0;
+  size_t _cq_ring_size = 0;
+  size_t _sqes_size    = 0;
+
+  std::atomic<uint32_t>* _sq_head = nullptr;
+  std::atomic<uint32_t>* _sq_tail = nullptr;
+  uint32_t  _sq_ring_mask = 0;
+  uint32_t* _sq_array     = nullptr;
+  std::atomic<uint32_t>* _cq_head = nullptr;
+  std::atomic<uint32_t>* _cq_tail = nullptr;
+  uint32_t _cq_ring_mask = 0;
+  io_uring_cqe* _cqes    = nullptr;
+
+  Buffer _buffers[buffer_count];
+  size_t _current_buffer = 0;
+  size_t _buffers_in_flight = 0;
+  uint64_t _file_offset = 0;
+};
+
+// -----------------------------------------------------------------------------
+/// output stream that owns an io_uring stream buffer
+class UringFileStream final : public std::ostream {
+ public:
+  explicit UringFileStream(const std::filesystem::path& path)
+  : std::ostream(nullptr), _buf(path) {
+    rdbuf(&_buf);
+  }
+
+  [[nodiscard]] bool is_open() const {
+    return _buf.is_open();
+  }
+
+ private:
+  UringFileBuf _buf;
+};
+
+// -----------------------------------------------------------------------------
+/// create an io_uring-backed stream; null when io_uring is unavailable
+// the caller is expected to fall back to a synchronous stream
+std::unique_ptr<std::ostream> make_uring_file_stream(const std::filesystem::path& path) {
+  auto stream = std::make_unique<UringFileStream>(path);
+  if (!stream->is_open()) {
+    return nullptr;
+  }
+  return stream;
+}
+
+// -----------------------------------------------------------------------------
+}   // namespace gioppler::linux
+
+#endif // defined GIOPPLER_PLATFORM_LINUX
+
+// -----------------------------------------------------------------------------
+#endif // defined GIOPPLER_LINUX_URING_HPP
@@ -27,6 +27,7 @@
 #error C++20 or newer support required to use this header-only library.
 #endif
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <deque>
@@ -44,16 +45,26 @@
 #include <unordered_map>
 #include <utility>
 #include <variant>
+#include <vector>
 #include <version>
 
 #include <cassert>
 #include <cerrno>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
+#include "gioppler/config.hpp"
+#include "gioppler/utility.hpp"
+#include "gioppler/counter.hpp"
+#include "gioppler/thread.hpp"
+
 // -----------------------------------------------------------------------------
 namespace gioppler {
 
+// the profiler counts through the Linux perf events for now
+using linux::LinuxEventsData;
+
 // ---------------------------------------------------------------------------
 class ProfileData {
  public:
@@ -63,11 +74,43 @@ class ProfileData {
       _parent_function_signature(parent_function_signature),
       _function_signature(function_signature),
       _function_calls(),
+      _profiled_calls(),
       _sum_of_count(),
       _linux_event_data_total(),
       _linux_event_data_self() {
   }
 
+  /// every call is counted exactly, sampled or not
+  void add_call(const double count) {
+    ++_function_calls;
+    _sum_of_count += count;
+  }
+
+  /// event data is only captured for the sampled subset of calls
+  void add_sampled_events(const LinuxEventsData &event_data_total,
+                          const LinuxEventsData &event_data_self) {
+    ++_profiled_calls;
+    _linux_event_data_total += event_data_total;
+    _linux_event_data_self  += event_data_self;
+  }
+
+  /// factor that undoes the sampling when reporting event data
+  // the realized call/sample ratio, not the configured rate, so the
+  // estimate stays unbiased when the rate is changed mid-run
+  [[nodiscard]] double get_sampling_scale() const {
+    return _profiled_calls == 0 ? 1.0
+        : static_cast<double>(_function_calls)/static_cast<double>(_profiled_calls);
+  }
+
+  /// accumulated event data scaled back up by the sampling factor
+  [[nodiscard]] LinuxEventsData get_scaled_event_data_total() const {
+    return _linux_event_data_total*get_sampling_scale();
+  }
+
+  [[nodiscard]] LinuxEventsData get_scaled_event_data_self() const {
+    return _linux_event_data_self*get_sampling_scale();
+  }
+
   static void write_header(std::ostream &os) {
     os << "Subsystem,ParentFunction,Function,Calls,Count,";
     LinuxEventsData::write_header(os);
@@ -77,7 +120,13 @@ class ProfileData {
 
   }
 
+  [[nodiscard]] double get_sum_of_count() const {
+    return _sum_of_count;
+  }
+
   ProfileData &operator+=(const ProfileData &rhs) {
+    _function_calls += rhs._function_calls;
+    _profiled_calls += rhs._profiled_calls;
     _sum_of_count += rhs._sum_of_count;
     _linux_event_data_total += rhs._linux_event_data_total;
     _linux_event_data_self += rhs._linux_event_data_self;
@@ -90,6 +139,8 @@ class ProfileData {
   }
 
   ProfileData &operator-=(const ProfileData &rhs) {
+    _function_calls -= rhs._function_calls;
+    _profiled_calls -= rhs._profiled_calls;
     _sum_of_count -= rhs._sum_of_count;
     _linux_event_data_total -= rhs._linux_event_data_total;
     _linux_event_data_self -= rhs._linux_event_data_self;
@@ -105,79 +156,313 @@ class ProfileData {
   const std::string_view _parent_function_signature;
   const std::string_view _function_signature;
   uint64_t _function_calls;
+  uint64_t _profiled_calls;   // calls for which event data was captured
   double _sum_of_count;
   LinuxEventsData _linux_event_data_total;
   LinuxEventsData _linux_event_data_self;
 };
 
+// ---------------------------------------------------------------------------
+/// flat open-addressing table of profile data, keyed by call-site constants
+// the key is the address of the site's function_name() literal - a per-site
+// integer constant - so the hot upsert is a multiply, a mask, and usually
+// one slot compare: no string hashing and no node allocation per call
+// thread-local use only, so there is no synchronization
+class ProfileTable {
+ public:
+  struct Entry {
+    uintptr_t   _key;
+    ProfileData _data;
+  };
+
+  ProfileTable() : _slots(initial_slot_count) { }
+
+  /// find or create the profile entry for a call-site key
+  ProfileData& upsert(const uintptr_t key, const std::string_view function_signature) {
+    assert(key != empty_key);
+    if ((_entries+1)*4 > _slots.size()*3) {   // keep the load factor under 75%
+      grow_slots();
+    }
+    std::size_t index = slot_index(key, _slots.size());
+    while (_slots[index]._key != key) {
+      if (_slots[index]._key == empty_key) {   // claim the empty slot
+        _slots[index]._key   = key;
+        _slots[index]._index = static_cast<uint32_t>(_profile_entries.size());
+        _profile_entries.emplace_back(Entry{key, ProfileData{""sv, function_signature}});
+        ++_entries;
+        break;
+      }
+      index = (index+1) & (_slots.size()-1);
+    }
+    return _profile_entries[_slots[index]._index]._data;
+  }
+
+  [[nodiscard]] bool empty() const {
+    return _profile_entries.empty();
+  }
+
+  auto begin() { return _profile_entries.begin(); }
+  auto end()   { return _profile_entries.end(); }
+
+  void clear() {
+    _profile_entries.clear();
+    std::fill(_slots.begin(), _slots.end(), Slot{});
+    _entries = 0;
+  }
+
+ private:
+  struct Slot {
+    uintptr_t _key   = empty_key;
+    uint32_t  _index = 0;   // into _profile_entries
+  };
+
+  static constexpr uintptr_t   empty_key          = 0;
+  static constexpr std::size_t initial_slot_count = 256;   // power of two
+
+  std::vector<Slot> _slots;
+  std::deque<Entry> _profile_entries;   // deque keeps ProfileData addresses stable
+  std::size_t _entries = 0;
+
+  // Fibonacci hashing spreads the pointer-valued keys across the table
+  static std::size_t slot_index(const uintptr_t key, const std::size_t slot_count) {
+    return static_cast<std::size_t>((key*UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (slot_count-1);
+  }
+
+  void grow_slots() {
+    std::vector<Slot> old_slots = std::move(_slots);
+    _slots.assign(old_slots.size()*2, Slot{});
+    for (const Slot& slot : old_slots) {
+      if (slot._key == empty_key)   continue;
+      std::size_t index = slot_index(slot._key, _slots.size());
+      while (_slots[index]._key != empty_key) {
+        index = (index+1) & (_slots.size()-1);
+      }
+      _slots[index] = slot;
+    }
+  }
+};
+
 // -----------------------------------------------------------------------------
-template<BuildMode build_mode = g_build_mode>
-class Function {
+/// shared profiler state - one copy, not one per Function instantiation
+// Function is a template over the subsystem name and build mode, so any
+// static state left inside it would be duplicated per instantiation; the
+// thread shards, the global map, and the sampling configuration live here
+// so every subsystem folds into the same tables.
+class ProfileStore {
  public:
-  Function([[maybe_unused]] const std::string_view subsystem = "",
-           [[maybe_unused]] const double count = 0.0,
-           [[maybe_unused]] std::string session = "",
-           [[maybe_unused]] const std::source_location &location =
-           std::source_location::current())
-  requires (build_mode == BuildMode::off) {
+  /// find or create this thread's profile entry for a call-site key
+  static ProfileData& upsert_call_site(const uintptr_t profile_key,
+                                       const std::string_view function_signature) {
+    return _thread_shard._table.upsert(profile_key, function_signature);
   }
 
-  Function(const std::string_view subsystem = "",
-           const double count = 0.0,
-           std::string session = "",
-           const std::source_location &location = std::source_location::current())
-  requires (build_mode == BuildMode::profile) {
-    check_create_program_thread();
+  /// capture event data for one call in every_nth_call, per subsystem
+  // an empty subsystem name sets the default rate; 1 means every call
+  // (exact); cold subsystems can stay exact while hot ones sample.
+  // captured event data is scaled back up by the realized call/sample
+  // ratio when reported - see ProfileData::get_sampling_scale
+  static void set_sample_rate(const uint64_t every_nth_call,
+                              const std::string_view subsystem = ""sv) {
+    const std::lock_guard<std::mutex> lock{_sample_rate_mutex};
+    const uint64_t rate = every_nth_call == 0 ? 1 : every_nth_call;
+    if (subsystem.empty()) {
+      _default_sample_rate = rate;
+    } else {
+      _subsystem_sample_rates.insert_or_assign(std::string{subsystem}, rate);
+    }
   }
 
-  ~Function() {
-    check_destroy_program_thread();
+  /// true on every Nth call for the subsystem, per thread
+  // the skip path is a hash probe and a decrement; the configured rate is
+  // only re-read (under the lock) when the countdown expires
+  static bool should_sample(const std::string_view subsystem) {
+    struct Countdown {
+      uint64_t _remaining = 1;   // sample the first call immediately
+    };
+    static thread_local std::unordered_map<std::string, Countdown, string_hash, std::equal_to<>>
+        countdowns;
+
+    auto entry = countdowns.find(subsystem);
+    if (entry == countdowns.end()) [[unlikely]] {
+      entry = countdowns.emplace(std::string{subsystem}, Countdown{}).first;
+    }
+    if (--entry->second._remaining == 0) {
+      entry->second._remaining = get_sample_rate(subsystem);
+      return true;
+    }
+    return false;
+  }
+
+  /// push a children-event accumulator for a sampled call that is starting
+  // One shared stack per thread, across Function instantiations, so nesting
+  // between subsystems still attributes children to the right parent.
+  static void begin_sampled_call() {
+    sampled_frames().emplace_back();
+  }
+
+  /// record the event data for a sampled call that is ending
+  // total covers the whole call; self subtracts the nested sampled calls
+  // accumulated in this frame. A nested call that was not itself sampled
+  // read no counters, so its events stay attributed to this call's self
+  // data - an accepted bias of sampling only every Nth call.
+  static void end_sampled_call(ProfileData& profile_data, const LinuxEventsData& event_data_total) {
+    const LinuxEventsData event_data_children = sampled_frames().back();
+    sampled_frames().pop_back();
+    if (!sampled_frames().empty()) {   // roll this call up into its parent frame
+      sampled_frames().back() += event_data_total;
+    }
+    profile_data.add_sampled_events(event_data_total, event_data_total-event_data_children);
+  }
+
+  static void write_profile_map() {
+    merge_thread_profile_map();   // pick up the reporting thread's shard
+    const std::lock_guard<std::mutex> lock{_global_map_mutex};
+
+    // sort descending by accumulated count
+    std::multimap<double, const ProfileData*, std::greater<>> sorted_profiles;
+    for (const auto &profile : _global_profile_map) {
+      sorted_profiles.emplace(profile.second.get_sum_of_count(), &profile.second);
+    }
+
+    for ([[maybe_unused]] const auto &[sum_of_count, profile_data] : sorted_profiles) {
+      // profile_data->write_data(std::cout);
+    }
   }
 
  private:
-  using ProfileKey = std::pair<std::string_view, std::string_view>;
-  static std::unordered_map<ProfileKey, ProfileData> _profile_map;
-  static std::mutex _map_mutex;
+  // Each thread accumulates into its own flat table with zero
+  // synchronization. The global map and its mutex are only touched when a
+  // shard is merged - on thread exit or at final report time - so the
+  // global side can stay a plain node-based map.
+  // The shard folds itself into the global map from its own destructor:
+  // a thread exit callback would read the table after the thread_local
+  // destruction order already tore it down.
+  struct ThreadShard {
+    ProfileTable _table;
+
+    ~ThreadShard() {
+      merge_thread_profile_map();
+    }
+  };
+
+  static thread_local inline ThreadShard _thread_shard;
+  static inline std::unordered_map<uintptr_t, ProfileData> _global_profile_map;
+  static inline std::mutex _global_map_mutex;
+
+  /// configured sampling rates: profile one call in N
+  static inline std::unordered_map<std::string, uint64_t, string_hash, std::equal_to<>>
+      _subsystem_sample_rates;
+  static inline uint64_t _default_sample_rate = 1;   // exact by default
+  static inline std::mutex _sample_rate_mutex;
+
+  /// children-event accumulators for the active sampled calls, innermost last
+  static std::vector<LinuxEventsData>& sampled_frames() {
+    static thread_local std::vector<LinuxEventsData> frames;
+    return frames;
+  }
 
-  static thread_local inline std::stack<Function<build_mode>>  _functions;
-  static thread_local inline std::stack<std::string>  _subsystems;
-  static thread_local inline std::stack<std::string>  _sessions;
+  static uint64_t get_sample_rate(const std::string_view subsystem) {
+    const std::lock_guard<std::mutex> lock{_sample_rate_mutex};
+    const auto entry = _subsystem_sample_rates.find(subsystem);
+    return entry == _subsystem_sample_rates.end() ? _default_sample_rate : entry->second;
+  }
 
-  // all accesses require modifying data
-  // no advantage to use a readers-writer lock (a.k.a. shared_mutex)
-  static void upsert_profile_map(const ProfileData &profile_record) {
+  /// fold this thread's shard into the global map and reset the shard
+  // the only place the global mutex is taken; once per thread lifetime
+  // plus once at report time, instead of once per profiled call
+  static void merge_thread_profile_map() {
+    if (_thread_shard._table.empty())   return;
+    const std::lock_guard<std::mutex> lock{_global_map_mutex};
+    for (auto &[profile_key, profile_data] : _thread_shard._table) {
+      const auto [entry, inserted] = _global_profile_map.try_emplace(profile_key, profile_data);
+      if (!inserted) {
+        entry->second += profile_data;
+      }
+    }
+    _thread_shard._table.clear();
+  }
+};
 
+// -----------------------------------------------------------------------------
+/// profile a function for a subsystem named at compile time
+// Instrumentation stays in the source for every subsystem; only the
+// subsystems on the g_enabled_subsystems list (see config.hpp) compile to
+// anything. Function<"network"> for a delisted "network" instantiates the
+// empty body below - no per-call string, no allocation, no code - so the
+// cost of dormant instrumentation is literally zero.
+template<SubsystemName subsystem = SubsystemName{""}, BuildMode build_mode = g_build_mode>
+class Function {
+  /// does this instantiation profile at all?
+  static constexpr bool profiled =
+      build_mode == BuildMode::Prof && is_subsystem_enabled(subsystem.view());
+
+ public:
+  Function([[maybe_unused]] const double count = 0.0,
+           [[maybe_unused]] const std::source_location &location =
+           std::source_location::current())
+  requires (!profiled) {
   }
 
-  void write_profile_map() {
-    // sort descending by key
-    std::multimap<double, ProfileKey, std::greater<>> sorted_profiles;
-    sorted_profiles.reserve(_profile_map.size());
+  Function(const double count = 0.0,
+           const std::source_location &location = std::source_location::current())
+  requires (profiled) {
+    check_create_program_thread();
 
-    // or sorted_profiles.copy(_profile_map.keys())
-    //    sorted_profiles.sort()
+    // the key is a per-call-site constant - the address of the function
+    // signature literal - so the upsert is a table probe with no string
+    // hashing; the entry pointer is kept so the exit-path update is a
+    // direct store, with no lookup at all
+    const auto profile_key = reinterpret_cast<uintptr_t>(location.function_name());
+    _profile_data = &ProfileStore::upsert_call_site(profile_key, location.function_name());
+    _profile_data->add_call(count);
 
-    for (const auto &profile : _profile_map) {
-      sorted_profiles.push_back(profile.first);
+    // every call is counted exactly; only every Nth call (per subsystem)
+    // gets its performance counters captured, so the hottest functions
+    // pay one countdown decrement on the skip path instead of the reads
+    _sampled = ProfileStore::should_sample(subsystem.view());
+    if (_sampled) {
+      linux::LinuxEvents& events = linux::get_thread_events();
+      events.enable_events();
+      _events_start = events.get_snapshot();
+      ProfileStore::begin_sampled_call();
     }
+  }
 
-    for (const auto &profile : sorted_profiles) {
-      // std::cout << _profile_map[profile] << ' ';
+  ~Function() {
+    if constexpr (profiled) {
+      if (_sampled) {
+        const LinuxEventsData event_data_total =
+            linux::get_thread_events().get_snapshot()-_events_start;
+        ProfileStore::end_sampled_call(*_profile_data, event_data_total);
+      }
+      check_destroy_program_thread();
     }
   }
 
+  /// forwards to the shared store - see ProfileStore::set_sample_rate
+  static void set_sample_rate(const uint64_t every_nth_call,
+                              const std::string_view for_subsystem = ""sv) {
+    ProfileStore::set_sample_rate(every_nth_call, for_subsystem);
+  }
+
+ private:
+  /// was this call selected for event-data capture?
+  bool _sampled = false;
+
+  /// counter values at entry; the destructor diffs against a fresh snapshot
+  LinuxEventsData _events_start{};
+
+  /// this call's entry in the thread's profile table
+  // cached so the exit path updates it without any lookup
+  ProfileData* _profile_data = nullptr;
+
   void check_create_program_thread() {
-    Program::check_create();
-    Thread::check_create();
+    (void) get_thread().get_id();   // make sure the thread-local state exists
   }
 
   void check_destroy_program_thread() {
-    if (_functions.empty()) {
-      Thread::destroy();
-    }
     if (Thread::all_threads_done()) {
-      write_profile_map();
-      Program::check_destroy();
+      ProfileStore::write_profile_map();
     }
   }
 };
@@ -28,8 +28,10 @@
 #endif
 
 #include <chrono>
+#include <cstdlib>
 #include <mutex>
 
+#include "gioppler/sink.hpp"
 #include "gioppler/utility.hpp"
 
 // -----------------------------------------------------------------------------
@@ -46,12 +48,16 @@ extern void gioppler_exit();
 // -----------------------------------------------------------------------------
 class Program {
  public:
-  Program() : _start{now()} { }
+  Program() : _start{now()} {
+    // quick_exit skips the static destructors, so the sinks must be stopped
+    // through the exit hook instead of through ~SinkManager
+    (void) std::at_quick_exit(gioppler_exit);
+  }
 
   ~Program() {
     const Timestamp end = now();
     const TimestampDiff diff = end - _start;
-    double _duration_secs = diff.count();
+    [[maybe_unused]] double _duration_secs = diff.count();
     // ...
   }
 
@@ -60,7 +66,24 @@ class Program {
 };
 
 // -----------------------------------------------------------------------------
-static inline Program g_program{};
+/// the program object, materialized by the first event on any thread
+// a function-local static, so a short-lived process that never logs pays
+// no construction cost at startup and no teardown cost at exit; the
+// measured duration consequently starts at the first event, not at load
+inline Program& get_program() {
+  static Program program;
+  return program;
+}
+
+// -----------------------------------------------------------------------------
+/// flush queued records and stop the sinks, bounded by the shutdown deadline
+// Registered with at_quick_exit when the program object materializes, so a
+// quick_exit path never hangs waiting on sink workers whose static
+// destructors will not run. Safe to call directly ahead of _exit or exec;
+// the normal-exit destructors do the same work, so calling twice is harmless.
+inline void gioppler_exit() {
+  sink::get_sink_manager().shutdown();
+}
 
 // -----------------------------------------------------------------------------
 }   // namespace gioppler
@@ -27,20 +27,29 @@
 #error C++20 or newer support required to use this library.
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstddef>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <random>
 #include <source_location>
+#include <string>
+#include <string_view>
 #include <syncstream>
-#include <unordered_map>
+#include <utility>
 #include <variant>
+#include <vector>
 using namespace std::literals;
 
 #include "gioppler/config.hpp"
 #include "gioppler/platform.hpp"
+#include "gioppler/utility.hpp"
 
 // -----------------------------------------------------------------------------
 namespace gioppler {
@@ -92,6 +101,68 @@ namespace gioppler {
 // - prof.hw.branch_instructions - integer   - Retired branch instructions (i.e., executed)
 // - prof.hw.branch_misses       - integer   - Mispredicted branch instructions.
 
+// -----------------------------------------------------------------------------
+/// compile-time interned field key
+// A key is a 4-byte id computed from the field name by a consteval FNV-1a
+// hash, plus a view of the name literal so serializers can map the id back
+// to its text. The consteval constructor means keys can only be built from
+// compile-time strings, so the event path never allocates, hashes, or
+// compares field-name characters - lookups and merges compare the ids.
+class RecordKey {
+ public:
+  template<std::size_t N>
+  consteval RecordKey(const char (&name)[N])
+  : _id(hash_name({name, N-1})), _name(name, N-1) { }
+
+  [[nodiscard]] constexpr uint32_t id() const {
+    return _id;
+  }
+
+  [[nodiscard]] constexpr std::string_view name() const {
+    return _name;
+  }
+
+  constexpr bool operator==(const RecordKey& other) const {
+    return _id == other._id;
+  }
+
+  /// runtime-built key for configuration paths, e.g. sink field lists
+  // the event hot path still only uses the consteval forms; this exists so
+  // a sink can resolve its configured field names to ids once, at setup
+  // time - the name must outlive the key, since only the view is kept
+  [[nodiscard]] static RecordKey intern(const std::string_view name) {
+    return RecordKey{name};
+  }
+
+ private:
+  friend consteval RecordKey operator""_rk(const char* name, std::size_t length);
+
+  constexpr RecordKey(const std::string_view name)
+  : _id(hash_name(name)), _name(name) { }
+
+  /// FNV-1a (32-bit)
+  // http://www.isthe.com/chongo/tech/comp/fnv/index.html
+  static constexpr uint32_t hash_name(const std::string_view name) {
+    uint32_t hash = UINT32_C(2166136261);
+    for (const char character : name) {
+      hash ^= static_cast<uint8_t>(character);
+      hash *= UINT32_C(16777619);
+    }
+    return hash;
+  }
+
+  uint32_t _id;
+  std::string_view _name;
+};
+
+// -----------------------------------------------------------------------------
+/// produce an interned key from a string literal: "category"_rk
+// a user-defined literal is an immediate invocation, so the hash is always
+// computed at compile time even in the middle of a runtime expression
+consteval RecordKey operator""_rk(const char* name, const std::size_t length) {
+  return RecordKey{std::string_view{name, length}};
+}
+
 // -----------------------------------------------------------------------------
 /// replacement for std::variant; eventually will be a wrapper
 // std::variant is currently broken
@@ -110,6 +181,44 @@ class RecordValue
     return _record_value_type;
   }
 
+  // ---------------------------------------------------------------------------
+  // The value members live in a union, so a RecordValue is a one-byte tag
+  // plus the largest member instead of the sum of all of them, and the
+  // std::string member is only constructed when the value really is a string.
+  RecordValue(const RecordValue& other)
+  : _record_value_type(other._record_value_type)
+  {
+    copy_value(other);
+  }
+
+  RecordValue(RecordValue&& other) noexcept
+  : _record_value_type(other._record_value_type)
+  {
+    move_value(std::move(other));
+  }
+
+  RecordValue& operator=(const RecordValue& other) {
+    if (this != &other) {
+      destroy_value();
+      _record_value_type = other._record_value_type;
+      copy_value(other);
+    }
+    return *this;
+  }
+
+  RecordValue& operator=(RecordValue&& other) noexcept {
+    if (this != &other) {
+      destroy_value();
+      _record_value_type = other._record_value_type;
+      move_value(std::move(other));
+    }
+    return *this;
+  }
+
+  ~RecordValue() {
+    destroy_value();
+  }
+
   // ---------------------------------------------------------------------------
   RecordValue(const bool bool_value)
   : _record_value_type(Type::Bool), _bool_value(bool_value) { }
@@ -159,10 +268,15 @@ class RecordValue
   RecordValue(std::string_view string_value)
   : _record_value_type(Type::String), _string_value(string_value) { }
 
+  // without this, a string literal prefers the standard pointer-to-bool
+  // conversion over the string_view converting constructor
+  RecordValue(const char* string_value)
+  : _record_value_type(Type::String), _string_value(string_value) { }
+
   RecordValue(std::string string_value)
   : _record_value_type(Type::String), _string_value(std::move(string_value)) { }
 
-  [[nodiscard]] std::string get_string() const {
+  [[nodiscard]] const std::string& get_string() const {
     assert(_record_value_type == Type::String);
     return _string_value;
   }
@@ -187,17 +301,393 @@ class RecordValue
   }
 
  private:
+  /// start the lifetime of the union member matching the other value's tag
+  // assumes our own active member, if any, has already been destroyed
+  void copy_value(const RecordValue& other) {
+    switch (_record_value_type) {
+      case Type::Bool:      _bool_value      = other._bool_value;       break;
+      case Type::Int:       _int_value       = other._int_value;        break;
+      case Type::Real:      _real_value      = other._real_value;       break;
+      case Type::String:    new (&_string_value) std::string(other._string_value);   break;
+      case Type::Timestamp: _timestamp_value = other._timestamp_value;  break;
+    }
+  }
+
+  void move_value(RecordValue&& other) noexcept {
+    switch (_record_value_type) {
+      case Type::Bool:      _bool_value      = other._bool_value;       break;
+      case Type::Int:       _int_value       = other._int_value;        break;
+      case Type::Real:      _real_value      = other._real_value;       break;
+      case Type::String:    new (&_string_value) std::string(std::move(other._string_value));   break;
+      case Type::Timestamp: _timestamp_value = other._timestamp_value;  break;
+    }
+  }
+
+  /// only the string member has a non-trivial destructor
+  void destroy_value() {
+    if (_record_value_type == Type::String) {
+      _string_value.~basic_string();
+    }
+  }
+
   Type _record_value_type;
-  bool _bool_value{};
-  int64_t _int_value{};
-  double _real_value{};
-  std::string _string_value{};
-  Timestamp _timestamp_value{};
+  union {
+    bool _bool_value;
+    int64_t _int_value;
+    double _real_value;
+    std::string _string_value;
+    Timestamp _timestamp_value;
+  };
 };
 
 // -----------------------------------------------------------------------------
 /// Data being sent to a sink for processing.
-using Record = std::unordered_map<std::string, RecordValue>;
+// Flat array of key/value pairs instead of a hash map.
+// Our records typically carry 10-20 fields, so a linear scan for lookup and
+// merge beats a hash table, and the inline storage means creating a record
+// and iterating it for serialization touches one contiguous block of memory
+// with no per-field heap allocations.
+class Record
+{
+ public:
+  using value_type     = std::pair<RecordKey, RecordValue>;
+  using iterator       = value_type*;
+  using const_iterator = const value_type*;
+
+  Record() = default;
+
+  Record(std::initializer_list<value_type> init) {
+    reserve(init.size());
+    for (const auto& field : init) {
+      emplace_back(field.first, field.second);
+    }
+  }
+
+  Record(const Record& other) {
+    reserve(other._size);
+    for (const value_type& field : other) {
+      emplace_back(field.first, field.second);
+    }
+    _site = other._site;
+  }
+
+  Record(Record&& other) noexcept {
+    move_from(std::move(other));
+  }
+
+  Record& operator=(const Record& other) {
+    if (this != &other) {
+      clear();
+      reserve(other._size);
+      for (const value_type& field : other) {
+        emplace_back(field.first, field.second);
+      }
+      _site = other._site;
+    }
+    return *this;
+  }
+
+  Record& operator=(Record&& other) noexcept {
+    if (this != &other) {
+      clear();
+      release_storage();
+      move_from(std::move(other));
+    }
+    return *this;
+  }
+
+  ~Record() {
+    clear();
+    release_storage();
+  }
+
+  [[nodiscard]] size_t size()  const { return _size; }
+  [[nodiscard]] bool   empty() const { return _size == 0; }
+
+  [[nodiscard]] iterator       begin()        { return _data; }
+  [[nodiscard]] iterator       end()          { return _data+_size; }
+  [[nodiscard]] const_iterator begin()  const { return _data; }
+  [[nodiscard]] const_iterator end()    const { return _data+_size; }
+  [[nodiscard]] const_iterator cbegin() const { return _data; }
+  [[nodiscard]] const_iterator cend()   const { return _data+_size; }
+
+  /// append a field without checking for duplicate keys
+  template<typename... Args>
+  void emplace_back(Args&&... args) {
+    if (_size == _capacity) [[unlikely]] {
+      grow(_capacity*2);
+    }
+    new (_data+_size) value_type(std::forward<Args>(args)...);
+    ++_size;
+  }
+
+  /// linear scan for the field with the given key - a 4-byte id compare per entry
+  // falls through to the attached call-site record, if any
+  [[nodiscard]] const RecordValue* find(const RecordKey key) const {
+    for (const value_type& field : *this) {
+      if (field.first == key)   return &field.second;
+    }
+    if (_site)   return _site->find(key);
+    return nullptr;
+  }
+
+  [[nodiscard]] RecordValue* find(const RecordKey key) {
+    return const_cast<RecordValue*>(std::as_const(*this).find(key));
+  }
+
+  [[nodiscard]] bool contains(const RecordKey key) const {
+    return find(key) != nullptr;
+  }
+
+  /// add the fields of another record, skipping keys already present
+  // matches the semantics of std::unordered_map::merge
+  void merge(const Record& other) {
+    reserve(_size+other._size);
+    for (const value_type& field : other) {
+      if (!contains(field.first)) {
+        emplace_back(field.first, field.second);
+      }
+    }
+  }
+
+  void merge(Record&& other) {
+    reserve(_size+other._size);
+    for (value_type& field : other) {
+      if (!contains(field.first)) {
+        emplace_back(std::move(field.first), std::move(field.second));
+      }
+    }
+    other.clear();
+  }
+
+  /// attach the shared immutable record for the originating call site
+  // merged by reference: the fields stay in the shared record and are only
+  // visited at lookup and serialization time, never copied per event
+  void set_site(std::shared_ptr<const Record> site) {
+    _site = std::move(site);
+  }
+
+  [[nodiscard]] const Record* site() const {
+    return _site.get();
+  }
+
+  /// visit every field: own fields first, then call-site fields not shadowed
+  // serializers use this so attached call-site fields appear in the output
+  template<typename Visitor>
+  void for_each_field(Visitor&& visitor) const {
+    for (const value_type& field : *this) {
+      visitor(field.first, field.second);
+    }
+    if (_site) {
+      for (const value_type& field : *_site) {
+        if (find(field.first) == &field.second) {   // not shadowed by an own field
+          visitor(field.first, field.second);
+        }
+      }
+    }
+  }
+
+  /// number of fields a visit yields, including unshadowed call-site fields
+  [[nodiscard]] size_t field_count() const {
+    size_t count = 0;
+    for_each_field([&count](const RecordKey, const RecordValue&) { ++count; });
+    return count;
+  }
+
+  void reserve(const size_t capacity) {
+    if (capacity > _capacity) {
+      grow(capacity);
+    }
+  }
+
+  void clear() {
+    std::destroy_n(_data, _size);
+    _size = 0;
+    _site.reset();
+  }
+
+ private:
+  /// enough inline slots for a typical fully merged record
+  static constexpr size_t inline_capacity = 20;
+
+  [[nodiscard]] bool is_inline() const {
+    return _data == reinterpret_cast<const value_type*>(_inline_storage);
+  }
+
+  /// move the fields into fresh storage of at least the given capacity
+  void grow(const size_t min_capacity) {
+    const size_t new_capacity = std::max(min_capacity, _capacity*2);
+    value_type* new_data = static_cast<value_type*>(
+        ::operator new(new_capacity*sizeof(value_type), std::align_val_t{alignof(value_type)}));
+    std::uninitialized_move_n(_data, _size, new_data);
+    std::destroy_n(_data, _size);
+    release_storage();
+    _data     = new_data;
+    _capacity = new_capacity;
+  }
+
+  /// free the heap block, if any, and point back at the inline buffer
+  void release_storage() {
+    if (!is_inline()) {
+      ::operator delete(_data, std::align_val_t{alignof(value_type)});
+    }
+    _data     = reinterpret_cast<value_type*>(_inline_storage);
+    _capacity = inline_capacity;
+  }
+
+  /// steal the other record's heap block or move its inline fields
+  // assumes our own storage is empty/released
+  void move_from(Record&& other) noexcept {
+    _site = std::move(other._site);
+    if (other.is_inline()) {
+      std::uninitialized_move_n(other._data, other._size, _data);
+      _size = other._size;
+      other.clear();
+    } else {
+      _data     = other._data;
+      _size     = other._size;
+      _capacity = other._capacity;
+      other._data     = reinterpret_cast<value_type*>(other._inline_storage);
+      other._size     = 0;
+      other._capacity = inline_capacity;
+    }
+  }
+
+  value_type* _data = reinterpret_cast<value_type*>(_inline_storage);
+  size_t _size      = 0;
+  size_t _capacity  = inline_capacity;
+  std::shared_ptr<const Record> _site;   // shared per-call-site fields, if attached
+  alignas(value_type) std::byte _inline_storage[inline_capacity*sizeof(value_type)];
+};
+
+// -----------------------------------------------------------------------------
+/// Recycling pool of Record objects for the event hot path.
+// Each thread owns one pool (hanging off get_thread()), so acquiring a record is
+// an uncontended freelist pop with no malloc in steady state. Records handed
+// out as shared_ptr carry a deleter that returns them to the pool when the
+// sink writer thread drops the last reference; shared_ptr control blocks are
+// recycled through the same pool, so releasing a record does no free either.
+// The pool state is reference counted so records still in flight when their
+// owning thread exits keep the backing slabs alive until they are released.
+class RecordPool {
+ public:
+  RecordPool() : _state(std::make_shared<PoolState>()) { }
+
+  RecordPool(const RecordPool&) = delete;
+  RecordPool& operator=(const RecordPool&) = delete;
+
+  /// acquire a pooled record, initialized with the given fields
+  std::shared_ptr<Record> make_record(std::initializer_list<Record::value_type> init) {
+    Record* record = _state->acquire_record();
+    for (const Record::value_type& field : init) {
+      record->emplace_back(field.first, field.second);
+    }
+    return std::shared_ptr<Record>(record, Recycler{_state}, BlockAllocator<Record>{_state});
+  }
+
+ private:
+  /// records are allocated in slabs of this many
+  static constexpr size_t slab_size = 32;
+
+  /// large enough for a shared_ptr control block with deleter and allocator
+  static constexpr size_t block_size = 128;
+
+  /// shared between the owning thread and the deleters of records in flight
+  struct PoolState {
+    Record* acquire_record() {
+      const std::lock_guard<std::mutex> lock{_mutex};
+      if (_free_records.empty()) [[unlikely]] {
+        add_slab();
+      }
+      Record* record = _free_records.back();
+      _free_records.pop_back();
+      return record;
+    }
+
+    void release_record(Record* record) {
+      record->clear();   // run field destructors before the record idles
+      const std::lock_guard<std::mutex> lock{_mutex};
+      _free_records.push_back(record);
+    }
+
+    void* acquire_block() {
+      const std::lock_guard<std::mutex> lock{_mutex};
+      if (_free_blocks.empty()) [[unlikely]] {
+        _block_slabs.emplace_back(std::make_unique<Block[]>(slab_size));
+        for (size_t index = 0; index < slab_size; ++index) {
+          _free_blocks.push_back(&_block_slabs.back()[index]);
+        }
+      }
+      void* block = _free_blocks.back();
+      _free_blocks.pop_back();
+      return block;
+    }
+
+    void release_block(void* block) {
+      const std::lock_guard<std::mutex> lock{_mutex};
+      _free_blocks.push_back(block);
+    }
+
+   private:
+    struct alignas(std::max_align_t) Block {
+      std::byte _storage[block_size];
+    };
+
+    void add_slab() {
+      _record_slabs.emplace_back(std::make_unique<Record[]>(slab_size));
+      for (size_t index = 0; index < slab_size; ++index) {
+        _free_records.push_back(&_record_slabs.back()[index]);
+      }
+    }
+
+    std::mutex _mutex;   // uncontended except when a sink thread returns a record
+    std::vector<Record*> _free_records;
+    std::vector<void*> _free_blocks;
+    std::vector<std::unique_ptr<Record[]>> _record_slabs;
+    std::vector<std::unique_ptr<Block[]>> _block_slabs;
+  };
+
+  /// shared_ptr deleter that hands the record back to its pool
+  struct Recycler {
+    void operator()(Record* record) const {
+      _state->release_record(record);
+    }
+    std::shared_ptr<PoolState> _state;
+  };
+
+  /// allocator used for the shared_ptr control blocks, backed by the pool
+  template<typename T>
+  struct BlockAllocator {
+    using value_type = T;
+
+    explicit BlockAllocator(std::shared_ptr<PoolState> state) : _state(std::move(state)) { }
+
+    template<typename U>
+    BlockAllocator(const BlockAllocator<U>& other) : _state(other._state) { }
+
+    T* allocate(const size_t count) {
+      if (count == 1 && sizeof(T) <= block_size) [[likely]] {
+        return static_cast<T*>(_state->acquire_block());
+      }
+      return static_cast<T*>(::operator new(count*sizeof(T)));
+    }
+
+    void deallocate(T* pointer, const size_t count) {
+      if (count == 1 && sizeof(T) <= block_size) [[likely]] {
+        _state->release_block(pointer);
+      } else {
+        ::operator delete(pointer);
+      }
+    }
+
+    template<typename U>
+    bool operator==(const BlockAllocator<U>& other) const { return _state == other._state; }
+
+    std::shared_ptr<PoolState> _state;
+  };
+
+  std::shared_ptr<PoolState> _state;
+};
 
 // -----------------------------------------------------------------------------
 /// convert a source_location into a string
@@ -205,13 +695,34 @@ using Record = std::unordered_map<std::string, RecordValue>;
 Record source_location_to_record(const std::source_location &location)
 {
   return Record{
-      {"file", location.file_name()},
-      {"line", location.line()},
-      {"column", location.column()},
-      {"function", location.function_name()}
+      {"file"_rk, location.file_name()},
+      {"line"_rk, location.line()},
+      {"column"_rk, location.column()},
+      {"function"_rk, location.function_name()}
   };
 }
 
+// -----------------------------------------------------------------------------
+/// shared immutable record for a call site, built once and cached
+// file_name() and function_name() point into static storage, so the
+// (file pointer, line, column) triple identifies the call site and its
+// record never changes. The cache is thread-local: a hit is one hash
+// probe with no lock and no allocation, and the result is attached to
+// event records by reference via Record::set_site.
+std::shared_ptr<const Record> get_source_location_record(const std::source_location &location)
+{
+  using SiteKey = std::pair<const void*, uint64_t>;
+  static thread_local std::unordered_map<SiteKey, std::shared_ptr<const Record>, pair_hash> site_records;
+
+  const SiteKey site_key{location.file_name(),
+                         (static_cast<uint64_t>(location.line()) << 32) | location.column()};
+  std::shared_ptr<const Record>& site_record = site_records[site_key];
+  if (!site_record) [[unlikely]] {
+    site_record = std::make_shared<const Record>(source_location_to_record(location));
+  }
+  return site_record;
+}
+
 // -----------------------------------------------------------------------------
 }   // namespace gioppler
 
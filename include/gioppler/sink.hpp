@@ -27,27 +27,50 @@
 #error C++20 or newer support required to use this library.
 #endif
 
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <charconv>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <fstream>
 #include <functional>
-#include <future>
 #include <iostream>
-#include <list>
 #include <memory>
 #include <mutex>
 #include <ostream>
+#include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 using namespace std::chrono_literals;
 
+#include "gioppler/compress.hpp"
 #include "gioppler/config.hpp"
+#include "gioppler/record.hpp"
 #include "gioppler/utility.hpp"
 
+#if defined(GIOPPLER_PLATFORM_LINUX)
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>                    // SSE2/AVX2 escape scanning
+#endif
+
 // -----------------------------------------------------------------------------
 namespace gioppler::sink {
 
@@ -62,66 +85,733 @@ namespace gioppler::sink {
 //   it is safe to concurrently access these objects from multiple threads for both formatted and unformatted output.
 //   Due to the overhead necessitated by thread-safety, no other stream objects are thread-safe by default.
 
+// -----------------------------------------------------------------------------
+/// compiled per-sink record filter - a conjunction of field conditions
+// Built once when the sink is added, then evaluated against every record as
+// a flat array of (key, op, value) conditions: a 4-byte key lookup and a
+// typed compare per condition, with no formatting and no allocation. An
+// empty filter accepts everything. Conditions are ANDed together.
+// Example - keep only contract events:
+//   Json::add_sink("<current>", RecordFilter{}
+//       .where("category"_rk, RecordFilter::Op::Equal, "contract"));
+class RecordFilter {
+ public:
+  enum class Op {Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual, Contains};
+
+  RecordFilter() = default;
+
+  /// append one condition; the record must satisfy all of them to pass
+  RecordFilter& where(const RecordKey key, const Op op, RecordValue value) {
+    _conditions.emplace_back(Condition{key, op, std::move(value)});
+    return *this;
+  }
+
+  [[nodiscard]] bool empty() const {
+    return _conditions.empty();
+  }
+
+  /// does the record satisfy every condition?
+  // a missing field or a field of a different type fails its condition
+  [[nodiscard]] bool accepts(const Record& record) const {
+    for (const Condition& condition : _conditions) {
+      const RecordValue* value = record.find(condition._key);
+      if (value == nullptr || !matches(*value, condition)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  struct Condition {
+    RecordKey _key;
+    Op _op;
+    RecordValue _value;
+  };
+
+  static bool matches(const RecordValue& value, const Condition& condition) {
+    if (value.get_type() != condition._value.get_type()) {
+      return false;
+    }
+
+    if (condition._op == Op::Contains) {
+      return value.get_type() == RecordValue::Type::String &&
+             value.get_string().find(condition._value.get_string()) != std::string::npos;
+    }
+
+    const int comparison = compare(value, condition._value);
+    switch (condition._op) {
+      case Op::Equal:        return comparison == 0;
+      case Op::NotEqual:     return comparison != 0;
+      case Op::Less:         return comparison <  0;
+      case Op::LessEqual:    return comparison <= 0;
+      case Op::Greater:      return comparison >  0;
+      case Op::GreaterEqual: return comparison >= 0;
+      default:               assert(false);   return false;
+    }
+  }
+
+  /// three-way compare of two values of the same type
+  static int compare(const RecordValue& left, const RecordValue& right) {
+    switch (left.get_type()) {
+      case RecordValue::Type::Bool:      return order(left.get_bool(), right.get_bool());
+      case RecordValue::Type::Int:       return order(left.get_int(), right.get_int());
+      case RecordValue::Type::Real:      return order(left.get_real(), right.get_real());
+      case RecordValue::Type::String:    return left.get_string().compare(right.get_string());
+      case RecordValue::Type::Timestamp: return order(left.get_timestamp(), right.get_timestamp());
+      default:                           assert(false);   return 0;
+    }
+  }
+
+  template<typename T>
+  static int order(const T& left, const T& right) {
+    return (left > right)-(left < right);
+  }
+
+  std::vector<Condition> _conditions;
+};
+
 // -----------------------------------------------------------------------------
 struct Sink {
   virtual ~Sink() = default;
   virtual bool write_record(std::shared_ptr<Record> record) = 0;
+
+  /// batch path: the writer thread hands over every record accumulated since
+  /// the last flush, so sinks can serialize them with one buffered write
+  // default implementation just forwards to the single-record path
+  virtual void write_records(std::span<const std::shared_ptr<Record>> records) {
+    for (const auto& record : records) {
+      write_record(record);
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// What to do when a sink's record queue fills up faster than it drains.
+// Block      - producer spins/yields until a slot opens (no records lost)
+// DropOldest - producer discards the oldest queued record to make room
+enum class BackpressurePolicy {Block, DropOldest};
+
+// -----------------------------------------------------------------------------
+/// Bounded lock-free multi-producer/multi-consumer queue of records.
+// Fixed power-of-two capacity ring of cells, each tagged with a sequence
+// counter, so producers and consumers claim slots with one fetch_add plus
+// one store each and never take a lock.
+// Based on the classic bounded MPMC queue design by Dmitry Vyukov.
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// Note: this is an internal class intended to be called only from SinkManager
+class RecordQueue {
+ public:
+  explicit RecordQueue(const size_t capacity)
+  : _capacity_mask(round_up_pow2(capacity)-1), _cells(_capacity_mask+1)
+  {
+    for (size_t index = 0; index <= _capacity_mask; ++index) {
+      _cells[index]._sequence.store(index, std::memory_order_relaxed);
+    }
+  }
+
+  RecordQueue(const RecordQueue&) = delete;
+  RecordQueue& operator=(const RecordQueue&) = delete;
+
+  /// Attempt to enqueue a record without blocking. Returns false when full.
+  bool try_push(std::shared_ptr<Record> record) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = _cells[tail & _capacity_mask];
+      const size_t sequence = cell._sequence.load(std::memory_order_acquire);
+      const intptr_t delta = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(tail);
+      if (delta == 0) {
+        if (_tail.compare_exchange_weak(tail, tail+1, std::memory_order_relaxed)) {
+          cell._record = std::move(record);
+          cell._sequence.store(tail+1, std::memory_order_release);
+          return true;
+        }
+      } else if (delta < 0) {
+        return false;   // queue is full
+      } else {
+        tail = _tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Attempt to dequeue a record without blocking. Returns false when empty.
+  bool try_pop(std::shared_ptr<Record>& record) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = _cells[head & _capacity_mask];
+      const size_t sequence = cell._sequence.load(std::memory_order_acquire);
+      const intptr_t delta = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(head+1);
+      if (delta == 0) {
+        if (_head.compare_exchange_weak(head, head+1, std::memory_order_relaxed)) {
+          record = std::move(cell._record);
+          cell._sequence.store(head+_capacity_mask+1, std::memory_order_release);
+          return true;
+        }
+      } else if (delta < 0) {
+        return false;   // queue is empty
+      } else {
+        head = _head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> _sequence;
+    std::shared_ptr<Record> _record;
+  };
+
+  static size_t round_up_pow2(size_t value) {
+    size_t pow2 = 2;
+    while (pow2 < value)   pow2 <<= 1;
+    return pow2;
+  }
+
+  alignas(64) std::atomic<size_t> _tail{};   // next slot to fill
+  alignas(64) std::atomic<size_t> _head{};   // next slot to drain
+  const size_t _capacity_mask;
+  std::vector<Cell> _cells;
 };
 
 // -----------------------------------------------------------------------------
 /// Sink management class. Thread safe.
+// Producer threads enqueue records into a bounded lock-free queue per sink.
+// One long-lived writer thread per sink drains its queue, so sink
+// implementations are only ever called from a single thread.
 class SinkManager {
  public:
-  SinkManager() : _sinks{}, _workers{} { }
+  SinkManager() : _workers{} { }
 
-  /// Waits for all sinks to finish processing data before exiting.
+  /// Waits for the sinks to finish processing data before exiting.
   ~SinkManager() {
+    shutdown();
+  }
+
+  /// Flush queued records and stop the sinks, bounded by the shutdown deadline.
+  // Idempotent: runs from the destructor on a normal exit and from
+  // gioppler_exit on quick_exit paths, where static destructors never run.
+  // Records still queued when the deadline passes are abandoned (counted to
+  // the log), so a short-lived process is never held hostage by a slow sink.
+  void shutdown() {
     const std::lock_guard<std::mutex> lock{_mutex};
-    wait_workers();
+    flush_repeat_runs();   // pending repeat summaries go out ahead of the drain
+    const auto deadline = std::chrono::steady_clock::now()+_shutdown_deadline;
+    for (auto&& worker : _workers) {   // one shared deadline, not one per sink
+      worker->set_drain_deadline(deadline);
+    }
+    _workers.clear();   // worker destructors drain their queues and join
   }
 
   /// Add another sink to the chain.
   void add_sink(std::unique_ptr<Sink> sink) {
     const std::lock_guard<std::mutex> lock{_mutex};
-    _sinks.emplace_back(std::move(sink));
+    _workers.emplace_back(std::make_unique<SinkWorker>(std::move(sink), _queue_capacity, _backpressure_policy));
   }
 
-  /// Write the record to the sink.
-  // Sink objects run in their own thread.
+  /// Set the policy used when a sink's queue is full. Applies to sinks added afterwards.
+  void set_backpressure_policy(const BackpressurePolicy policy) {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _backpressure_policy = policy;
+  }
+
+  /// Set the per-sink queue capacity (rounded up to a power of two). Applies to sinks added afterwards.
+  void set_queue_capacity(const size_t capacity) {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _queue_capacity = capacity;
+  }
+
+  /// Bound how long shutdown may spend flushing queued records.
+  // A CLI tool that forks thousands of short-lived processes cannot afford
+  // an unbounded drain at each exit; once the deadline passes, whatever is
+  // still queued is dropped rather than waiting on a slow or wedged sink.
+  // The deadline covers all sinks together, not each one in turn.
+  void set_shutdown_deadline(const std::chrono::milliseconds deadline) {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _shutdown_deadline = deadline;
+  }
+
+  /// Fold bursts of same-call-site records into one record plus a repeat count.
+  // A hot loop tripping the same contract emits thousands of identical
+  // records per second, and the sinks spend their time serializing
+  // duplicates. With a window set, the first record of a run passes through
+  // unchanged; later records from the same call site and category within
+  // the window are absorbed and a single summary record with a
+  // "repeat_count" field follows when the run ends - syslog's "message
+  // repeated N times". A zero window (the default) disables the stage.
+  // Configure at startup, before records flow, like the other settings here.
+  void set_coalescing_window(const std::chrono::milliseconds window) {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _coalescing_window = window;
+  }
+
+  /// Write the record to the sinks.
+  // Hot path: one lock-free push per sink; never blocks unless the
+  // backpressure policy is Block and the sink's queue is full.
   void write_record(std::shared_ptr<Record> record) {
     std::call_once(_create_sinks_once_flag, check_create_sinks);
-    const std::lock_guard<std::mutex> lock{_mutex};
-    check_workers();   // check before adding to avoid checking newly added workers
-    for (auto&& sink : _sinks) {
-      _workers.emplace_back(std::async(std::launch::async, [&sink, record]{return sink->write_record(record);}));
+    if (_coalescing_window.count() > 0 && coalesce_record(record)) [[unlikely]] {
+      return;   // absorbed into a repeat run; its summary record follows later
     }
+    fan_out(record);
   }
 
  private:
-  /// Sink objects are not copied but are called from multiple threads, one for each worker.
-  std::vector<std::unique_ptr<Sink>> _sinks;
-  std::list<std::future<bool>> _workers;
+  /// Pairs a sink with its record queue and its dedicated writer thread.
+  struct SinkWorker {
+    SinkWorker(std::unique_ptr<Sink> sink, const size_t queue_capacity, const BackpressurePolicy policy)
+    : _sink(std::move(sink)), _queue(queue_capacity), _policy(policy),
+      _writer_thread([this](std::stop_token stop_token){ drain_queue(stop_token); }) { }
+
+    /// Request stop first, so the writer wakes, drains, and exits before members die.
+    ~SinkWorker() {
+      _writer_thread.request_stop();
+      wake_writer();
+      _writer_thread.join();
+    }
+
+    /// Called by producer threads. Applies the backpressure policy when full.
+    void push_record(std::shared_ptr<Record> record) {
+      while (!_queue.try_push(record)) [[unlikely]] {
+        if (_policy == BackpressurePolicy::DropOldest) {
+          std::shared_ptr<Record> dropped;
+          _queue.try_pop(dropped);   // make room; ok if the writer beat us to it
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      if (_pending.fetch_add(1, std::memory_order_release) == 0) {
+        wake_writer();   // writer may be sleeping on an empty queue
+      }
+    }
+
+    /// abandon the queue instead of draining it once this instant passes
+    // set by SinkManager::shutdown before the stop request; the default
+    // never arrives, preserving the drain-everything behavior
+    void set_drain_deadline(const std::chrono::steady_clock::time_point deadline) {
+      _drain_deadline.store(deadline, std::memory_order_release);
+    }
+
+    /// records per batch handed to the sink at most
+    static constexpr size_t max_batch_size = 512;
+
+    /// records per sink call; the drain deadline is re-checked between slices
+    // Small enough that a shutdown deadline arming mid-batch takes effect at
+    // the next slice instead of after the whole batch - with a slow sink,
+    // one full batch could hold the exiting process for seconds. The cost is
+    // sinks seeing at most this many records per write_records call (a
+    // compression frame per slice rather than per batch under heavy load).
+    static constexpr size_t write_slice = 32;
+
+    /// a partially filled batch is flushed this long after its first record,
+    /// so low-rate streams still appear promptly
+    static constexpr auto flush_interval = 10ms;
+
+    /// Writer thread main loop. Drains remaining records before exiting.
+    // Accumulates records into a batch and flushes it to the sink when the
+    // batch fills, the flush interval expires, or a stop is requested.
+    void drain_queue(std::stop_token stop_token) {
+      std::vector<std::shared_ptr<Record>> batch;
+      batch.reserve(max_batch_size);
+      std::chrono::steady_clock::time_point deadline{};
+      std::shared_ptr<Record> record;
+
+      const auto wake = [this, &stop_token]{
+        return stop_token.stop_requested() || _pending.load(std::memory_order_acquire) > 0;
+      };
+
+      while (true) {
+        const bool stopping = stop_token.stop_requested();
+
+        while (batch.size() < max_batch_size && _queue.try_pop(record)) {
+          _pending.fetch_sub(1, std::memory_order_release);
+          if (batch.empty()) {
+            deadline = std::chrono::steady_clock::now()+flush_interval;
+          }
+          batch.emplace_back(std::move(record));
+        }
+
+        if (!batch.empty() &&
+            (batch.size() >= max_batch_size || stopping ||
+             std::chrono::steady_clock::now() >= deadline)) {
+          // written slice by slice so the drain deadline is honored even
+          // when shutdown arms it while this batch is already in flight
+          size_t offset = 0;
+          while (offset < batch.size() &&
+                 std::chrono::steady_clock::now() <
+                     _drain_deadline.load(std::memory_order_acquire)) {
+            const size_t count = std::min(write_slice, batch.size()-offset);
+            _sink->write_records({batch.data()+offset, count});
+            offset += count;
+          }
+          batch.erase(batch.begin(), batch.begin()+static_cast<ptrdiff_t>(offset));
+        }
+
+        if (stopping && batch.empty() && _pending.load(std::memory_order_acquire) == 0) {
+          return;
+        }
+
+        if (stopping &&
+            std::chrono::steady_clock::now() >= _drain_deadline.load(std::memory_order_acquire)) {
+          size_t abandoned = batch.size();
+          while (_queue.try_pop(record))   ++abandoned;
+          if (abandoned) {
+            std::clog << "INFO: gioppler sink shutdown deadline reached, abandoning "
+                      << abandoned << " records" << std::endl;
+          }
+          return;
+        }
+
+        if (!stopping && _pending.load(std::memory_order_acquire) == 0) {
+          std::unique_lock<std::mutex> lock{_wake_mutex};
+          if (batch.empty()) {
+            _wake_condition.wait_for(lock, 10ms, wake);
+          } else {
+            _wake_condition.wait_until(lock, deadline, wake);
+          }
+        }
+      }
+    }
+
+    void wake_writer() {
+      const std::lock_guard<std::mutex> lock{_wake_mutex};
+      _wake_condition.notify_one();
+    }
+
+    std::unique_ptr<Sink> _sink;
+    RecordQueue _queue;
+    BackpressurePolicy _policy;
+    std::atomic<size_t> _pending{};   // records pushed but not yet drained
+    std::atomic<std::chrono::steady_clock::time_point> _drain_deadline{
+        std::chrono::steady_clock::time_point::max()};
+    std::mutex _wake_mutex;
+    std::condition_variable _wake_condition;
+    std::jthread _writer_thread;   // last member, so it stops before the rest
+  };
+
+  /// pending run of identical records being folded into a repeat count
+  struct RepeatRun {
+    std::shared_ptr<Record> _record;
+    uint64_t _repeats;   // records absorbed after the first
+    std::chrono::steady_clock::time_point _deadline;
+  };
+
+  /// push one record to every sink queue
+  void fan_out(const std::shared_ptr<Record>& record) {
+    for (auto&& worker : _workers) {
+      worker->push_record(record);
+    }
+  }
+
+  /// returns true when the record was absorbed into a pending repeat run
+  // Takes a small lock; the stage is opt-in, so the lock-free hot path is
+  // untouched when coalescing is off. Expired runs are only collected under
+  // the lock - their summaries fan out after it is released, because a push
+  // onto a full sink queue can block (under the Block policy), and blocking
+  // inside the lock would stall every producer with a coalescible record.
+  bool coalesce_record(const std::shared_ptr<Record>& record) {
+    const uint64_t key = coalesce_key(*record);
+    if (key == 0)   return false;   // no call site and no category to key on
+
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<RepeatRun> expired;
+    bool absorbed = false;
+    {
+      const std::lock_guard<std::mutex> lock{_coalesce_mutex};
+      const auto entry = _repeat_runs.find(key);
+      if (entry != _repeat_runs.end()) {
+        if (now < entry->second._deadline) {
+          ++entry->second._repeats;
+          absorbed = true;
+        } else {   // the run's window has closed
+          expired.emplace_back(std::move(entry->second));
+          _repeat_runs.erase(entry);
+        }
+      }
+      if (!absorbed) {
+        if (now >= _next_sweep) {   // close out runs whose call sites went quiet
+          collect_expired_runs(now, expired);
+        }
+        _repeat_runs.emplace(key, RepeatRun{record, 0, now+_coalescing_window});
+      }
+    }
+    emit_repeat_summaries(expired);
+    // when not absorbed, the first record of the run follows from the caller,
+    // after its predecessor's summary above - order is preserved
+    return absorbed;
+  }
+
+  /// move expired runs out of the map; bounds it when many call sites burst
+  // briefly - called with _coalesce_mutex held
+  void collect_expired_runs(const std::chrono::steady_clock::time_point now,
+                            std::vector<RepeatRun>& expired) {
+    for (auto entry = _repeat_runs.begin(); entry != _repeat_runs.end(); ) {
+      if (now >= entry->second._deadline) {
+        expired.emplace_back(std::move(entry->second));
+        entry = _repeat_runs.erase(entry);
+      } else {
+        ++entry;
+      }
+    }
+    _next_sweep = now+_coalescing_window;
+  }
+
+  void flush_repeat_runs() {
+    std::vector<RepeatRun> expired;
+    {
+      const std::lock_guard<std::mutex> lock{_coalesce_mutex};
+      expired.reserve(_repeat_runs.size());
+      for (auto& [key, run] : _repeat_runs) {
+        expired.emplace_back(std::move(run));
+      }
+      _repeat_runs.clear();
+    }
+    emit_repeat_summaries(expired);
+  }
+
+  /// a copy of each run's first record plus how many repeats were absorbed
+  // Called with _coalesce_mutex released, since the fan-out can block on a
+  // full sink queue. Summaries are rare (one per run), so a plain allocation
+  // is fine here and avoids reaching back into a producer's record pool.
+  void emit_repeat_summaries(const std::vector<RepeatRun>& expired) {
+    for (const RepeatRun& run : expired) {
+      if (run._repeats == 0)   continue;   // no repeats - the original already went out
+      auto summary = std::make_shared<Record>(*run._record);
+      summary->emplace_back("repeat_count"_rk, static_cast<int64_t>(run._repeats));
+      fan_out(summary);
+    }
+  }
+
+  /// identity of a record for coalescing: call site (file, line) plus category
+  // zero means the record carries neither and cannot be coalesced
+  [[nodiscard]] static uint64_t coalesce_key(const Record& record) {
+    uint64_t hash = UINT64_C(14695981039346656037);   // FNV-1a
+    const auto mix_text = [&hash](const std::string_view text) {
+      for (const char character : text) {
+        hash = (hash ^ static_cast<uint8_t>(character))*UINT64_C(1099511628211);
+      }
+      hash = (hash ^ 0xff)*UINT64_C(1099511628211);   // field separator
+    };
+
+    bool keyed = false;
+    if (const RecordValue* file = record.find("file"_rk);
+        file && file->get_type() == RecordValue::Type::String) {
+      mix_text(file->get_string());
+      keyed = true;
+    }
+    if (const RecordValue* line = record.find("line"_rk);
+        line && line->get_type() == RecordValue::Type::Int) {
+      hash = (hash ^ static_cast<uint64_t>(line->get_int()))*UINT64_C(1099511628211);
+      keyed = true;
+    }
+    if (const RecordValue* category = record.find("category"_rk);
+        category && category->get_type() == RecordValue::Type::String) {
+      mix_text(category->get_string());
+      keyed = true;
+    }
+    return keyed ? (hash ? hash : 1) : 0;
+  }
+
+  /// Workers are only added while holding the mutex; the hot path reads them unlocked.
+  // Sinks are expected to be configured at startup, before records flow.
+  std::vector<std::unique_ptr<SinkWorker>> _workers;
   std::mutex _mutex;
   std::once_flag _create_sinks_once_flag;
+  BackpressurePolicy _backpressure_policy = BackpressurePolicy::Block;
+  size_t _queue_capacity = 8192;
+  std::chrono::milliseconds _shutdown_deadline{5'000};
+
+  std::chrono::milliseconds _coalescing_window{0};   // zero: coalescing off
+  std::mutex _coalesce_mutex;
+  std::unordered_map<uint64_t, RepeatRun> _repeat_runs;
+  std::chrono::steady_clock::time_point _next_sweep{};
 
   /// Create default sinks if write attempted and no sinks defined already
   static void check_create_sinks();
+};
+
+// -----------------------------------------------------------------------------
+/// the sink manager, materialized by the first record written or sink added
+// A function-local static instead of a global, so a process that merely
+// links the library - a CLI tool forking thousands of times per hour - never
+// pays for construction, and a process that never logs never pays for the
+// shutdown drain either.
+inline SinkManager& get_sink_manager() {
+  static SinkManager sink_manager;
+  return sink_manager;
+}
+
+// -----------------------------------------------------------------------------
+/// append a number to the buffer using std::to_chars
+// locale-free and allocation-free, unlike streaming through format()
+template<typename T>
+void append_number(std::string& buffer, const T value) {
+  std::array<char, 32> digits;   // large enough for int64_t and shortest double
+  const auto [end, error_code] = std::to_chars(digits.data(), digits.data()+digits.size(), value);
+  assert(error_code == std::errc());
+  buffer.append(digits.data(), end);
+}
+
+inline void append_bool(std::string& buffer, const bool value) {
+  buffer.append(value ? "true" : "false");
+}
+
+// -----------------------------------------------------------------------------
+/// does this byte need escaping inside a JSON string?
+// quote, backslash, or a control byte; bytes >= 0x80 are UTF-8
+// continuation/lead bytes and pass through untouched
+constexpr bool is_json_unclean(const char character) {
+  return static_cast<uint8_t>(character) < 0x20 || character == '"' || character == '\\';
+}
+
+// -----------------------------------------------------------------------------
+/// index of the first byte needing a JSON escape, or size when none
+// Vectorized scan: 16 (SSE2) or 32 (AVX2) bytes are tested per step for
+// quote, backslash, and control bytes, so the common all-clean string costs
+// a few compares per cache line instead of a branch per character.
+inline size_t find_json_unclean(const char* data, const size_t size) {
+  size_t index = 0;
 
-  /// Check and remove workers that have already finished executing.
-  void check_workers() {
-    _workers.remove_if([](std::future<bool>& fut)
-      { return fut.wait_for(0s) == std::future_status::ready; });
+#if defined(__AVX2__)
+  const __m256i quotes      = _mm256_set1_epi8('"');
+  const __m256i backslashes = _mm256_set1_epi8('\\');
+  const __m256i last_ctrl   = _mm256_set1_epi8(0x1f);
+  for (; index+32 <= size; index += 32) {
+    const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data+index));
+    const __m256i unclean =
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, quotes),
+                                        _mm256_cmpeq_epi8(block, backslashes)),
+                        _mm256_cmpeq_epi8(_mm256_min_epu8(block, last_ctrl), block));
+    const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(unclean));
+    if (mask != 0) {
+      return index+static_cast<size_t>(std::countr_zero(mask));
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i quotes      = _mm_set1_epi8('"');
+  const __m128i backslashes = _mm_set1_epi8('\\');
+  const __m128i last_ctrl   = _mm_set1_epi8(0x1f);
+  for (; index+16 <= size; index += 16) {
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data+index));
+    const __m128i unclean =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quotes),
+                                  _mm_cmpeq_epi8(block, backslashes)),
+                     _mm_cmpeq_epi8(_mm_min_epu8(block, last_ctrl), block));
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(unclean));
+    if (mask != 0) {
+      return index+static_cast<size_t>(std::countr_zero(mask));
+    }
   }
+#endif
 
-  /// Wait for the workers to finish and then delete them.
-  void wait_workers() {
-    _workers.remove_if([](std::future<bool>& fut)
-      { fut.wait(); return true; });
+  for (; index < size; ++index) {   // scalar fallback and vector tail
+    if (is_json_unclean(data[index]))   return index;
   }
-};
+  return size;
+}
+
+// -----------------------------------------------------------------------------
+/// append a string as JSON content, escaping as required
+// clean spans (the overwhelmingly common case) are bulk-copied between
+// escapes located by the vectorized scan above
+inline void append_json_escaped(std::string& buffer, const std::string_view text) {
+  size_t position = 0;
+  while (position < text.size()) {
+    const size_t clean = find_json_unclean(text.data()+position, text.size()-position);
+    buffer.append(text.data()+position, clean);
+    position += clean;
+    if (position == text.size())   break;
+
+    const char character = text[position++];
+    switch (character) {
+      case '"':  buffer.append("\\\"", 2);   break;
+      case '\\': buffer.append("\\\\", 2);   break;
+      case '\b': buffer.append("\\b", 2);    break;
+      case '\f': buffer.append("\\f", 2);    break;
+      case '\n': buffer.append("\\n", 2);    break;
+      case '\r': buffer.append("\\r", 2);    break;
+      case '\t': buffer.append("\\t", 2);    break;
+      default: {   // remaining control bytes become \u00xx
+        constexpr char hex_digits[] = "0123456789abcdef";
+        buffer.append("\\u00", 4);
+        buffer.push_back(hex_digits[(character >> 4) & 0xf]);
+        buffer.push_back(hex_digits[character & 0xf]);
+        break;
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+/// append a string as CSV content, doubling embedded quote characters
+// the scan for the next quote goes through memchr, which the C library
+// already vectorizes, so clean spans are located and bulk-copied the same
+// way as in the JSON path
+inline void append_csv_quoted(std::string& buffer, const std::string_view text, const char quote) {
+  size_t position = 0;
+  while (position < text.size()) {
+    const void* found = std::memchr(text.data()+position, quote, text.size()-position);
+    if (found == nullptr) {
+      buffer.append(text.data()+position, text.size()-position);
+      return;
+    }
+    const size_t quote_index = static_cast<size_t>(static_cast<const char*>(found)-text.data());
+    buffer.append(text.data()+position, quote_index-position+1);
+    buffer.push_back(quote);   // "" is the CSV escape for a quote
+    position = quote_index+1;
+  }
+}
 
 // -----------------------------------------------------------------------------
-static inline SinkManager g_sink_manager{};
+/// serialize one record as a JSON line into the buffer
+// shared by the Json sink and the flight recorder
+inline void append_record_json(std::string& buffer, const Record& record) {
+  bool first_field = true;
+  record.for_each_field([&buffer, &first_field](const RecordKey key, const RecordValue& value) {
+    if (first_field) {
+      first_field = false;
+    } else {
+      buffer.push_back(',');
+    }
+
+    buffer.push_back('"');
+    buffer.append(key.name());
+    buffer.append("\":", 2);
+
+    switch (value.get_type()) {
+      case RecordValue::Type::Bool: {
+        append_bool(buffer, value.get_bool());
+        break;
+      }
+
+      case RecordValue::Type::Int: {
+        append_number(buffer, value.get_int());
+        break;
+      }
+
+      case RecordValue::Type::Real: {
+        append_number(buffer, value.get_real());
+        break;
+      }
+
+      case RecordValue::Type::String: {
+        buffer.push_back('"');
+        append_json_escaped(buffer, value.get_string());
+        buffer.push_back('"');
+        break;
+      }
+
+      case RecordValue::Type::Timestamp: {
+        buffer.push_back('"');
+        buffer.append(format_timestamp(value.get_timestamp()));
+        buffer.push_back('"');
+        break;
+      }
+
+      default: assert(false);
+    }
+  });
+  buffer.push_back('\n');
+}
 
 // -----------------------------------------------------------------------------
 /// log file destination using JSON format
@@ -129,90 +819,827 @@ static inline SinkManager g_sink_manager{};
 // https://www.json.org/
 class Json : public Sink {
  public:
-  explicit Json(std::string_view filepath) {
-    _output_stream = get_output_filepath(filepath, "json"sv);
+  explicit Json(std::string_view filepath, RecordFilter filter = {},
+                const Compression compression = Compression::None, const int compression_level = 3)
+  : _filter(std::move(filter)), _compressed(compression != Compression::None)
+  {
+    _output_stream = wrap_compressed(get_output_filepath(filepath, "json"sv),
+                                     compression, compression_level);
+    _buffer.reserve(2*flush_threshold);
   }
 
-  ~Json() override = default;
+  ~Json() override {
+    flush_buffer();
+  }
 
   /// add a new JSON format data record sink
   // Directory patterns:
   //   <temp>, <current>, <home>   - optionally follow these with other directories
   //   <cout>, <clog>, <cerr>      - these specify the entire path
-  static void add_sink(std::string_view path = "<current>"sv) {
-    g_sink_manager.add_sink(std::make_unique<Json>(path));
+  static void add_sink(std::string_view path = "<current>"sv, RecordFilter filter = {},
+                       const Compression compression = Compression::None, const int compression_level = 3) {
+    get_sink_manager().add_sink(std::make_unique<Json>(path, std::move(filter), compression, compression_level));
   }
 
  protected:
+  /// serialize the whole batch, then push it to the stream as one block
+  void write_records(std::span<const std::shared_ptr<Record>> records) override {
+    for (const auto& record : records) {
+      write_record(record);
+    }
+    flush_buffer();
+    if (_compressed) {
+      _output_stream->flush();   // close the compression frame at the batch boundary
+    }
+  }
+
   bool write_record(std::shared_ptr<Record> record) override {
     if (is_record_filtered(*record)) {
       return false;
     }
 
-    std::stringstream buffer;
+    append_record_json(_buffer, *record);
+    if (_buffer.size() >= flush_threshold) {
+      flush_buffer();
+    }
+    return true;   // record was not filtered and it was written out
+  }
 
-    bool first_field = true;
-    for (const auto& [key, value] : *record) {
-      if (first_field) {
-        first_field = false;
-      } else {
-        buffer.put(',');
-      }
+ private:
+  /// flush to the stream in large blocks instead of per record
+  static constexpr size_t flush_threshold = 16*1024;
+
+  std::unique_ptr<std::ostream> _output_stream;
+  std::string _buffer;   // reused for every record; cleared, never reallocated
+  RecordFilter _filter;
+  bool _compressed;
+
+  void flush_buffer() {
+    _output_stream->write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+    _buffer.clear();
+  }
+
+  /// Skip writing this record due to filter conditions for sink?
+  bool is_record_filtered(const Record& record) {
+    return !_filter.accepts(record);
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// log file destination using a compact binary format
+// Length-prefixed binary encoding of Record, roughly 5-10x smaller than the
+// JSON text and trivially parseable: keys are interned, so each one's name is
+// written once in a key-definition entry the first time it appears, and
+// fields after that are a two-byte key id plus a fixed-width value. Output
+// goes through a memory-mapped append-only file grown in large chunks, so a
+// record write is a few stores with no syscall.
+//
+// File layout (all integers little-endian):
+//   magic "GIOP", format version u32
+//   entries:
+//     0x01 key definition - key id u16, name length u16, name bytes
+//     0x02 record         - field count u16, fields:
+//          key id u16, value type u8, payload:
+//            Bool u8, Int i64, Real f64, Timestamp i64 (ns since epoch),
+//            String u32 length + bytes
+#if defined(GIOPPLER_PLATFORM_LINUX)
+class Binary : public Sink {
+ public:
+  explicit Binary(std::string_view directory, RecordFilter filter = {})
+  : _filter(std::move(filter))
+  {
+    const std::filesystem::path directory_path = resolve_directory(directory);
+    const std::filesystem::path full_path      = directory_path/create_filename("bin");
+    std::clog << "INFO: setting gioppler binary log to " << full_path << std::endl;
+
+    _fd = ::open(full_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd == -1) {
+      std::cerr << "ERROR: Binary sink: " << full_path << ": " << std::strerror(errno) << std::endl;
+      return;
+    }
+    map_next_chunk();
+    append_bytes("GIOP", 4);
+    append_value(format_version);
+  }
+
+  ~Binary() override {
+    if (_base) {
+      ::munmap(_base, chunk_size);
+      ::ftruncate(_fd, static_cast<off_t>(_file_offset+_chunk_offset));   // trim the unused tail
+    }
+    if (_fd != -1)   ::close(_fd);
+  }
+
+  /// add a new binary format data record sink
+  // Directory patterns:
+  //   <temp>, <current>, <home>   - optionally follow these with other directories
+  // The console streams make no sense for a memory-mapped file, so they are not supported.
+  static void add_sink(std::string_view path = "<current>"sv, RecordFilter filter = {}) {
+    get_sink_manager().add_sink(std::make_unique<Binary>(path, std::move(filter)));
+  }
+
+ protected:
+  bool write_record(std::shared_ptr<Record> record) override {
+    if (!_base)   return false;
+    if (!_filter.accepts(*record))   return false;
+
+    record->for_each_field([this](const RecordKey key, const RecordValue&) {
+      intern_key(key);   // emit any new key definitions ahead of the record
+    });
+
+    append_value(static_cast<uint8_t>(0x02));
+    append_value(static_cast<uint16_t>(record->field_count()));
+    record->for_each_field([this](const RecordKey key, const RecordValue& value) {
+      append_value(_key_ids.at(key.id()));
+      append_value(static_cast<uint8_t>(value.get_type()));
 
       switch (value.get_type()) {
         case RecordValue::Type::Bool: {
-          buffer << format("\"{}\":{}", key, value.get_bool());
+          append_value(static_cast<uint8_t>(value.get_bool()));
           break;
         }
 
         case RecordValue::Type::Int: {
-          buffer << format("\"{}\":{}", key, value.get_int());
+          append_value(value.get_int());
           break;
         }
 
         case RecordValue::Type::Real: {
-          buffer << format("\"{}\":{}", key, value.get_real());
+          append_value(value.get_real());
           break;
         }
 
         case RecordValue::Type::String: {
-          buffer << format("\"{}\":\"{}\"", key, value.get_string());
+          append_value(static_cast<uint32_t>(value.get_string().size()));
+          append_bytes(value.get_string().data(), value.get_string().size());
           break;
         }
 
         case RecordValue::Type::Timestamp: {
-          buffer << format("\"{}\":\"{}\"", key, format_timestamp(value.get_timestamp()));
+          const int64_t timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              value.get_timestamp().time_since_epoch()).count();
+          append_value(timestamp_ns);
           break;
         }
 
         default: assert(false);
       }
+    });
+
+    return true;
+  }
+
+ private:
+  static constexpr uint32_t format_version = 1;
+  static constexpr size_t chunk_size = 4*1024*1024;   // file growth increment
+
+  int _fd = -1;
+  std::byte* _base = nullptr;   // current mapped chunk
+  size_t _chunk_offset = 0;     // next write position within the chunk
+  size_t _file_offset = 0;      // file position of the chunk start
+  std::unordered_map<uint32_t, uint16_t> _key_ids;   // interned key id -> file key id
+  RecordFilter _filter;
+
+  /// extend the file by one chunk and map it, retiring the previous mapping
+  void map_next_chunk() {
+    if (_base) {
+      ::munmap(_base, chunk_size);
+      _base = nullptr;
+      _file_offset += _chunk_offset;
+      _chunk_offset = 0;
     }
 
-    buffer.put('\n');
-    _output_stream->write(buffer.view().data(), buffer.view().size());
-    return true;   // record was not filtered and it was written out
+    if (::ftruncate(_fd, static_cast<off_t>(_file_offset+chunk_size)) == -1) {
+      std::cerr << "ERROR: Binary sink: ftruncate: " << std::strerror(errno) << std::endl;
+      return;
+    }
+    void* base = ::mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        _fd, static_cast<off_t>(_file_offset));
+    if (base == MAP_FAILED) {
+      std::cerr << "ERROR: Binary sink: mmap: " << std::strerror(errno) << std::endl;
+      return;
+    }
+    _base = static_cast<std::byte*>(base);
+  }
+
+  /// assign the key a file id and emit its definition entry on first sight
+  void intern_key(const RecordKey key) {
+    if (_key_ids.contains(key.id()))   return;
+    const uint16_t key_id = static_cast<uint16_t>(_key_ids.size());
+    _key_ids.emplace(key.id(), key_id);
+
+    append_value(static_cast<uint8_t>(0x01));
+    append_value(key_id);
+    append_value(static_cast<uint16_t>(key.name().size()));
+    append_bytes(key.name().data(), key.name().size());
+  }
+
+  /// copy into the mapped file, splitting across chunk boundaries as needed
+  // chunks retire with no padding, so a value straddling two chunks is still
+  // contiguous in the file - and a string longer than a whole chunk is fine
+  void append_bytes(const void* data, const size_t size) {
+    const std::byte* bytes = static_cast<const std::byte*>(data);
+    size_t remaining = size;
+    while (_base && remaining > 0) {
+      if (_chunk_offset == chunk_size) [[unlikely]] {
+        map_next_chunk();
+        continue;   // re-check _base - the remap can fail
+      }
+      const size_t step = std::min(remaining, chunk_size-_chunk_offset);
+      std::memcpy(_base+_chunk_offset, bytes, step);
+      _chunk_offset += step;
+      bytes         += step;
+      remaining     -= step;
+    }
+  }
+
+  template<typename T>
+  void append_value(const T value) {
+    append_bytes(&value, sizeof(value));
+  }
+};
+// -----------------------------------------------------------------------------
+/// flight recorder: a fixed-size memory-mapped ring of the latest records
+// Records serialized as JSON lines are memcpy'd into a mapped ring buffer
+// file, overwriting the oldest data, so the cost per record is the
+// serialization plus a copy into a mapped page - the kernel writes dirty
+// pages back lazily and nothing ever blocks on I/O. When a process dies with
+// records still queued or buffered in its regular sinks, the ring holds the
+// last ring_size bytes of history; dump_to_json recovers them post mortem.
+//
+// File layout (all integers little-endian):
+//   magic "GFLT", format version u32, ring size u64,
+//   write cursor u64 (total bytes ever written; cursor % size is the next
+//   write position), then the ring bytes
+class FlightRecorder : public Sink {
+ public:
+  explicit FlightRecorder(std::string_view directory, const size_t ring_size = 4*1024*1024)
+  : _ring_size(ring_size)
+  {
+    const std::filesystem::path directory_path = resolve_directory(directory);
+    const std::filesystem::path full_path      = directory_path/create_filename("gfr");
+    std::clog << "INFO: setting gioppler flight recorder to " << full_path << std::endl;
+
+    _fd = ::open(full_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd == -1) {
+      std::cerr << "ERROR: FlightRecorder: " << full_path << ": " << std::strerror(errno) << std::endl;
+      return;
+    }
+    if (::ftruncate(_fd, static_cast<off_t>(header_size+_ring_size)) == -1) {
+      std::cerr << "ERROR: FlightRecorder: ftruncate: " << std::strerror(errno) << std::endl;
+      return;
+    }
+    void* base = ::mmap(nullptr, header_size+_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (base == MAP_FAILED) {
+      std::cerr << "ERROR: FlightRecorder: mmap: " << std::strerror(errno) << std::endl;
+      return;
+    }
+    _base = static_cast<std::byte*>(base);
+    _ring = _base+header_size;
+
+    std::memcpy(_base, "GFLT", 4);
+    const uint32_t version = format_version;
+    const uint64_t size    = _ring_size;
+    std::memcpy(_base+4, &version, sizeof(version));
+    std::memcpy(_base+8, &size, sizeof(size));
+    store_cursor();
+  }
+
+  ~FlightRecorder() override {
+    if (_base) {
+      ::munmap(_base, header_size+_ring_size);
+    }
+    if (_fd != -1)   ::close(_fd);
+  }
+
+  /// add a new flight recorder sink
+  // Directory patterns:
+  //   <temp>, <current>, <home>   - optionally follow these with other directories
+  static void add_sink(std::string_view path = "<current>"sv, const size_t ring_size = 4*1024*1024) {
+    get_sink_manager().add_sink(std::make_unique<FlightRecorder>(path, ring_size));
+  }
+
+  /// reconstruct the JSON lines held in a flight recorder file
+  // the oldest (possibly partially overwritten) line is discarded;
+  // intended for post-mortem use, e.g. from a small dump utility
+  static void dump_to_json(const std::filesystem::path& path, std::ostream& output) {
+    std::ifstream file{path, std::ios::binary};
+    std::array<char, header_size> header;
+    if (!file.read(header.data(), header.size()) || std::memcmp(header.data(), "GFLT", 4) != 0) {
+      std::cerr << "ERROR: FlightRecorder: " << path << ": not a flight recorder file" << std::endl;
+      return;
+    }
+    uint64_t ring_size, cursor;
+    std::memcpy(&ring_size, header.data()+8, sizeof(ring_size));
+    std::memcpy(&cursor, header.data()+16, sizeof(cursor));
+
+    std::string ring(ring_size, '\0');
+    if (!file.read(ring.data(), static_cast<std::streamsize>(ring_size))) {
+      std::cerr << "ERROR: FlightRecorder: " << path << ": truncated file" << std::endl;
+      return;
+    }
+
+    std::string contents;
+    if (cursor <= ring_size) {   // the ring never wrapped
+      contents = ring.substr(0, cursor);
+    } else {                     // oldest data begins at the cursor
+      const size_t start = cursor % ring_size;
+      contents = ring.substr(start)+ring.substr(0, start);
+      const size_t first_newline = contents.find('\n');
+      contents.erase(0, first_newline == std::string::npos ? contents.size() : first_newline+1);
+    }
+    output.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+  }
+
+ protected:
+  bool write_record(std::shared_ptr<Record> record) override {
+    if (!_base)   return false;
+
+    _line.clear();
+    append_record_json(_line, *record);
+    copy_into_ring(_line.data(), _line.size());
+    store_cursor();
+    return true;
   }
 
  private:
-  std::unique_ptr<std::ostream> _output_stream;
-  std::mutex _mutex;
+  static constexpr uint32_t format_version = 1;
+  static constexpr size_t header_size = 24;
 
-  /// Skip writing this record due to filter conditions for sink?
-  bool is_record_filtered(const Record& record) {
+  int _fd = -1;
+  std::byte* _base = nullptr;
+  std::byte* _ring = nullptr;
+  size_t _ring_size;
+  uint64_t _cursor = 0;
+  std::string _line;   // reused serialization buffer
+
+  /// copy into the ring, wrapping over the oldest data as needed
+  void copy_into_ring(const char* data, size_t size) {
+    if (size > _ring_size) {   // keep only the newest tail of an oversized record
+      data += size-_ring_size;
+      size  = _ring_size;
+    }
+    const size_t position = _cursor % _ring_size;
+    const size_t first_part = std::min(size, _ring_size-position);
+    std::memcpy(_ring+position, data, first_part);
+    std::memcpy(_ring, data+first_part, size-first_part);
+    _cursor += size;
+  }
+
+  void store_cursor() {
+    std::memcpy(_base+16, &_cursor, sizeof(_cursor));
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// syslog destination through a non-blocking unix datagram socket
+// syslog(3) can block the caller when /dev/log backs up, so it has no place
+// on a logging path that must never stall the application. This sink is
+// incapable of blocking: the datagram socket is opened non-blocking, and a
+// full socket buffer drops the record (counted) instead of waiting for the
+// daemon to drain it. A token bucket per category caps the sustained rate,
+// so an error storm cannot saturate the socket and crowd out other output.
+// Records are sent as one RFC 3164 datagram each: a priority tag, the sink
+// identity, and the record's JSON line as the message body.
+// https://www.rfc-editor.org/rfc/rfc3164
+// https://man7.org/linux/man-pages/man3/syslog.3.html
+class Syslog : public Sink {
+ public:
+  explicit Syslog(std::string_view identity = "gioppler"sv,
+                  const double records_per_second = 100.0,
+                  const double burst_records      = 200.0,
+                  std::string_view socket_path    = "/dev/log"sv,
+                  RecordFilter filter = {})
+  : _identity(identity), _rate(records_per_second), _burst(burst_records), _filter(std::move(filter))
+  {
+    std::clog << "INFO: setting gioppler syslog sink to " << socket_path << std::endl;
+
+    _socket_fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_socket_fd == -1) {
+      std::cerr << "ERROR: Syslog: socket: " << std::strerror(errno) << std::endl;
+      return;
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+      std::cerr << "ERROR: Syslog: socket path too long: " << socket_path << std::endl;
+      close_socket();
+      return;
+    }
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    if (::connect(_socket_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1) {
+      std::cerr << "ERROR: Syslog: connect: " << socket_path << ": " << std::strerror(errno) << std::endl;
+      close_socket();
+      return;
+    }
+  }
+
+  ~Syslog() override {
+    if (_dropped_socket_full || _dropped_rate_limited) {
+      std::clog << "INFO: gioppler syslog sink dropped " << _dropped_socket_full
+                << " records on a full socket and " << _dropped_rate_limited
+                << " to rate limiting" << std::endl;
+    }
+    close_socket();
+  }
+
+  /// add a new syslog data record sink
+  // the rate limit is per category, so an error storm in one category
+  // cannot starve the records of another
+  static void add_sink(std::string_view identity = "gioppler"sv,
+                       const double records_per_second = 100.0,
+                       const double burst_records      = 200.0,
+                       std::string_view socket_path    = "/dev/log"sv,
+                       RecordFilter filter = {}) {
+    get_sink_manager().add_sink(std::make_unique<Syslog>(identity, records_per_second, burst_records,
+                                                     socket_path, std::move(filter)));
+  }
+
+  /// records discarded because the socket buffer was full
+  [[nodiscard]] uint64_t get_dropped_socket_full() const {
+    return _dropped_socket_full;
+  }
+
+  /// records discarded by the per-category token bucket
+  [[nodiscard]] uint64_t get_dropped_rate_limited() const {
+    return _dropped_rate_limited;
+  }
+
+ protected:
+  bool write_record(std::shared_ptr<Record> record) override {
+    if (_socket_fd == -1)            return false;
+    if (!_filter.accepts(*record))   return false;
+    if (!take_token(get_category(*record))) {
+      ++_dropped_rate_limited;
+      return false;
+    }
+
+    _line.clear();
+    _line += priority_tag(*record);
+    _line += _identity;
+    _line += ": ";
+    append_record_json(_line, *record);
+    _line.pop_back();   // datagrams are self-delimiting; drop the newline
+
+    // the socket is non-blocking, so send() returns immediately either way;
+    // a full buffer (EAGAIN/ENOBUFS) or an absent daemon is a counted drop
+    if (::send(_socket_fd, _line.data(), _line.size(), 0) == -1) {
+      ++_dropped_socket_full;
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  /// one token admits one record; refilled continuously at the configured rate
+  struct TokenBucket {
+    double _tokens;
+    std::chrono::steady_clock::time_point _last_refill;
+  };
+
+  int _socket_fd = -1;
+  std::string _identity;
+  double _rate;
+  double _burst;
+  RecordFilter _filter;
+  std::string _line;   // reused serialization buffer
+  uint64_t _dropped_socket_full  = 0;
+  uint64_t _dropped_rate_limited = 0;
+
+  /// one bucket per category - touched only from the sink worker, so unlocked
+  std::unordered_map<std::string, TokenBucket, string_hash, std::equal_to<>> _buckets;
+
+  void close_socket() {
+    if (_socket_fd != -1) {
+      ::close(_socket_fd);
+      _socket_fd = -1;
+    }
+  }
+
+  [[nodiscard]] static std::string_view get_category(const Record& record) {
+    const RecordValue* category = record.find("category"_rk);
+    if (category && category->get_type() == RecordValue::Type::String) {
+      return category->get_string();
+    }
+    return ""sv;
+  }
+
+  /// RFC 3164 priority: facility "user" (1), severity err for contract
+  // failures and info otherwise - the daemon supplies timestamp and host
+  [[nodiscard]] static std::string_view priority_tag(const Record& record) {
+    return get_category(record) == "contract"sv ? "<11>"sv : "<14>"sv;
+  }
+
+  [[nodiscard]] bool take_token(const std::string_view category) {
+    const auto now = std::chrono::steady_clock::now();
+    auto entry = _buckets.find(category);
+    if (entry == _buckets.end()) {
+      entry = _buckets.emplace(std::string{category}, TokenBucket{_burst, now}).first;
+    }
+    TokenBucket& bucket = entry->second;
+    const double elapsed_secs = std::chrono::duration<double>(now-bucket._last_refill).count();
+    bucket._tokens      = std::min(_burst, bucket._tokens+elapsed_secs*_rate);
+    bucket._last_refill = now;
+    if (bucket._tokens < 1.0)   return false;
+    bucket._tokens -= 1.0;
+    return true;
+  }
+};
+
+// -----------------------------------------------------------------------------
+/// network destination shipping JSON record batches over TCP
+// Replaces the tail-a-file-and-reparse pipeline: records are serialized
+// once, on the sink worker, and shipped as newline-delimited JSON batches
+// over a persistent TCP connection. When http_path is given, each batch is
+// wrapped in an HTTP/1.1 POST instead, for aggregators with an ingest URL.
+// The endpoint being down never builds unbounded state: unsent batches
+// collect in a bounded in-memory buffer, overflow spills to a local JSON
+// file (same format, for offline ingest after the outage), and reconnects
+// back off exponentially so a dead aggregator costs one cheap time check
+// per batch. Send timeouts keep a stalled peer from wedging the worker.
+class Network : public Sink {
+ public:
+  explicit Network(std::string_view host, const uint16_t port,
+                   std::string_view http_path = ""sv,
+                   std::string_view spill_directory = "<temp>"sv,
+                   RecordFilter filter = {})
+  : _host(host), _port(port), _http_path(http_path),
+    _spill_directory(spill_directory), _filter(std::move(filter))
+  {
+    std::clog << "INFO: setting gioppler network sink to " << _host << ":" << _port << std::endl;
+    _batch.reserve(2*ship_threshold);
+    check_connect();   // first connection attempt up front, so misconfiguration shows early
+  }
+
+  ~Network() override {
+    ship();
+    if (!_pending.empty()) {   // never discard buffered records at shutdown
+      spill(_pending);
+    }
+    if (_spilled_bytes) {
+      std::clog << "INFO: gioppler network sink spilled " << _spilled_bytes
+                << " bytes to local file" << std::endl;
+    }
+    close_connection();
+  }
+
+  /// add a new network shipping sink
+  // a non-empty http_path switches the framing from raw newline-delimited
+  // JSON to an HTTP/1.1 POST per batch
+  static void add_sink(std::string_view host, const uint16_t port,
+                       std::string_view http_path = ""sv,
+                       std::string_view spill_directory = "<temp>"sv,
+                       RecordFilter filter = {}) {
+    get_sink_manager().add_sink(std::make_unique<Network>(host, port, http_path,
+                                                      spill_directory, std::move(filter)));
+  }
+
+  /// bytes written to the local spill file because the endpoint was down
+  [[nodiscard]] uint64_t get_spilled_bytes() const {
+    return _spilled_bytes;
+  }
+
+ protected:
+  /// serialize the whole batch, then ship it with one send
+  void write_records(std::span<const std::shared_ptr<Record>> records) override {
+    for (const auto& record : records) {
+      write_record(record);
+    }
+    ship();
+  }
+
+  bool write_record(std::shared_ptr<Record> record) override {
+    if (!_filter.accepts(*record))   return false;
+
+    append_record_json(_batch, *record);
+    if (_batch.size() >= ship_threshold) {
+      ship();
+    }
+    return true;
+  }
+
+ private:
+  /// ship once this much is serialized, even mid-batch
+  static constexpr size_t ship_threshold = 64*1024;
+  /// unsent batches held in memory while the endpoint is down
+  static constexpr size_t pending_limit  = 1024*1024;
+  static constexpr std::chrono::milliseconds backoff_initial{100};
+  static constexpr std::chrono::milliseconds backoff_maximum{30'000};
+
+  std::string _host;
+  uint16_t _port;
+  std::string _http_path;
+  std::string _spill_directory;
+  RecordFilter _filter;
+
+  int _socket_fd = -1;
+  std::string _batch;     // reused serialization buffer
+  std::string _header;    // reused HTTP header buffer
+  std::string _pending;   // bounded buffer of unsent batches
+  std::chrono::milliseconds _backoff = backoff_initial;
+  std::chrono::steady_clock::time_point _next_attempt{};   // epoch: try immediately
+  bool _failure_logged = false;   // one message per outage, not per batch
+  std::ofstream _spill_stream;
+  uint64_t _spilled_bytes = 0;
+
+  /// hand the serialized batch to the connection, the buffer, or the spill file
+  void ship() {
+    if (_batch.empty())   return;
+
+    if (_socket_fd == -1) {
+      check_connect();
+    }
+    if (_socket_fd != -1) {
+      size_t consumed = 0;
+      if (send_all(_batch, consumed)) {
+        _batch.clear();
+        return;
+      }
+      _batch.erase(0, consumed);   // re-queue only the lines the peer lacks
+    }
+
+    if (_pending.size()+_batch.size() <= pending_limit) {
+      _pending += _batch;
+    } else {
+      spill(_pending);
+      _pending.clear();
+      spill(_batch);
+    }
+    _batch.clear();
+  }
+
+  /// reconnect if the exponential backoff window has elapsed
+  void check_connect() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now < _next_attempt)   return;
+
+    if (open_connection()) {
+      _backoff        = backoff_initial;
+      _failure_logged = false;
+      if (!_pending.empty()) {   // drain the outage backlog first
+        size_t consumed = 0;
+        if (send_all(_pending, consumed)) {
+          _pending.clear();
+        } else {
+          _pending.erase(0, consumed);
+        }
+      }
+    } else {
+      _next_attempt = now+_backoff;
+      _backoff      = std::min(2*_backoff, backoff_maximum);
+    }
+  }
+
+  [[nodiscard]] bool open_connection() {
+    addrinfo hints{};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    const std::string port_text = std::to_string(_port);
+    if (::getaddrinfo(_host.c_str(), port_text.c_str(), &hints, &addresses) != 0) {
+      log_failure("resolve");
+      return false;
+    }
+
+    for (const addrinfo* address = addresses; address; address = address->ai_next) {
+      _socket_fd = ::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC,
+                            address->ai_protocol);
+      if (_socket_fd == -1)   continue;
+
+      // a stalled peer must cost a bounded wait, never wedge the sink worker
+      const timeval timeout{.tv_sec = 1, .tv_usec = 0};
+      ::setsockopt(_socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      ::setsockopt(_socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+      if (::connect(_socket_fd, address->ai_addr, address->ai_addrlen) == 0) {
+        ::freeaddrinfo(addresses);
+        return true;
+      }
+      close_connection();
+    }
+    ::freeaddrinfo(addresses);
+    log_failure("connect");
+    return false;
+  }
+
+  void close_connection() {
+    if (_socket_fd != -1) {
+      ::close(_socket_fd);
+      _socket_fd = -1;
+    }
+  }
+
+  /// send the whole payload, HTTP-framed if configured; failure drops the connection
+  // On a raw-stream failure, consumed is set to the bytes delivered as
+  // complete lines, so the caller re-queues only whole unsent lines: the
+  // torn tail of a partially sent line dies with the closed connection and
+  // that line is resent in full, keeping the resumed stream valid NDJSON.
+  // An HTTP batch is all-or-nothing - the receiver discards a request whose
+  // body falls short of its Content-Length - so consumed stays zero there
+  // and a failed POST is simply reissued whole.
+  [[nodiscard]] bool send_all(const std::string& payload, size_t& consumed) {
+    consumed = 0;
+    if (!_http_path.empty()) {
+      _header.clear();
+      _header += "POST ";
+      _header += _http_path;
+      _header += " HTTP/1.1\r\nHost: ";
+      _header += _host;
+      _header += "\r\nContent-Type: application/x-ndjson\r\nContent-Length: ";
+      _header += std::to_string(payload.size());
+      _header += "\r\n\r\n";
+      if (send_buffer(_header) != _header.size())     return false;
+      if (send_buffer(payload) != payload.size())     return false;
+
+      // drain whatever response has arrived; never wait for it
+      char scratch[4096];
+      while (::recv(_socket_fd, scratch, sizeof(scratch), MSG_DONTWAIT) > 0) { }
+      consumed = payload.size();
+      return true;
+    }
+
+    const size_t sent = send_buffer(payload);
+    if (sent == payload.size()) {
+      consumed = sent;
+      return true;
+    }
+    if (sent > 0) {   // round down to the last line boundary the peer received
+      const size_t last_newline = payload.rfind('\n', sent-1);
+      consumed = last_newline == std::string::npos ? 0 : last_newline+1;
+    }
     return false;
   }
+
+  /// send as much of the buffer as possible; returns the byte count sent
+  [[nodiscard]] size_t send_buffer(const std::string& buffer) {
+    size_t sent = 0;
+    while (sent < buffer.size()) {
+      const ssize_t count =
+          ::send(_socket_fd, buffer.data()+sent, buffer.size()-sent, MSG_NOSIGNAL);
+      if (count == -1) {
+        if (errno == EINTR)   continue;
+        log_failure("send");
+        close_connection();
+        _next_attempt = std::chrono::steady_clock::now()+_backoff;
+        _backoff      = std::min(2*_backoff, backoff_maximum);
+        break;
+      }
+      sent += static_cast<size_t>(count);
+    }
+    return sent;
+  }
+
+  /// append to the local spill file, opening it on the first outage overflow
+  void spill(const std::string& data) {
+    if (data.empty())   return;
+    if (!_spill_stream.is_open()) {
+      const std::filesystem::path directory_path = resolve_directory(_spill_directory);
+      const std::filesystem::path full_path      = directory_path/create_filename("json");
+      std::clog << "INFO: gioppler network sink spilling to " << full_path << std::endl;
+      _spill_stream.open(full_path, std::ios::binary);
+      if (!_spill_stream.is_open()) {
+        std::cerr << "ERROR: Network sink: " << full_path << ": " << std::strerror(errno) << std::endl;
+        return;
+      }
+    }
+    _spill_stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+    _spill_stream.flush();   // an outage is exactly when buffered data gets lost
+    _spilled_bytes += data.size();
+  }
+
+  void log_failure(const char* what) {
+    if (_failure_logged)   return;
+    _failure_logged = true;
+    std::cerr << "WARNING: gioppler: network sink " << what << " failed for "
+              << _host << ":" << _port << ": " << std::strerror(errno)
+              << " (buffering, then spilling locally)" << std::endl;
+  }
 };
+#endif // defined GIOPPLER_PLATFORM_LINUX
 
 // -----------------------------------------------------------------------------
 /// log file destination using CSV format
+// Columns follow the configured field list, in order, so every row lines up
+// with the header; a field the record lacks becomes an empty column. The
+// field names are resolved to record key ids once, here, so serializing a
+// record is an id-compare lookup per column with no name hashing.
 class Csv : public Sink {
  public:
   explicit Csv(std::vector<std::string> fields, std::string_view filepath = "<current>"sv,
-      const bool header = true, std::string_view separator = ","sv, std::string_view string_quote = "\""sv)
-  : _fields(std::move(fields)), _header(header), _separator(separator), _string_quote(string_quote)
+      const bool header = true, std::string_view separator = ","sv, std::string_view string_quote = "\""sv,
+      RecordFilter filter = {},
+      const Compression compression = Compression::None, const int compression_level = 3)
+  : _fields(std::move(fields)), _header(header), _separator(separator), _string_quote(string_quote),
+    _filter(std::move(filter)), _compressed(compression != Compression::None)
   {
-    _output_stream = get_output_filepath(filepath, "txt");
+    _field_keys.reserve(_fields.size());
+    for (const std::string& field : _fields) {   // _fields owns the names the keys view
+      _field_keys.push_back(RecordKey::intern(field));
+    }
+
+    _output_stream = wrap_compressed(get_output_filepath(filepath, "txt"),
+                                     compression, compression_level);
     if (_header)   add_header();
   }
 
@@ -223,9 +1650,22 @@ class Csv : public Sink {
   //   <temp>, <current>, <home>   - optionally follow these with other directories
   //   <cout>, <clog>, <cerr>      - these specify the entire path
   static void add_sink(std::vector<std::string> fields, std::string_view filepath = "<current>"sv,
-    const bool header = true, std::string_view separator = ","sv, std::string_view string_quote = "\""sv)
+    const bool header = true, std::string_view separator = ","sv, std::string_view string_quote = "\""sv,
+    RecordFilter filter = {},
+    const Compression compression = Compression::None, const int compression_level = 3)
   {
-    g_sink_manager.add_sink(std::make_unique<Csv>(fields, filepath, header, separator, string_quote));
+    get_sink_manager().add_sink(std::make_unique<Csv>(fields, filepath, header, separator, string_quote,
+                                                  std::move(filter), compression, compression_level));
+  }
+
+  /// serialize the batch, then close the compression frame, if any
+  void write_records(std::span<const std::shared_ptr<Record>> records) override {
+    for (const auto& record : records) {
+      write_record(record);
+    }
+    if (_compressed) {
+      _output_stream->flush();
+    }
   }
 
  protected:
@@ -250,48 +1690,24 @@ class Csv : public Sink {
       return false;
     }
 
-    std::stringstream buffer;
+    // clearing keeps the capacity, so the buffer settles at the largest
+    // row seen and steady-state serialization never allocates
+    _line.clear();
 
     bool first_field = true;
-    for (const auto& [key, value] : *record) {
+    for (const RecordKey& key : _field_keys) {
       if (first_field) {
         first_field = false;
       } else {
-        buffer.write(_separator.data(), static_cast<std::streamsize>(_separator.size()));
-      }
-
-      switch (value.get_type()) {
-        case RecordValue::Type::Bool: {
-          buffer << format("{}", value.get_bool());
-          break;
-        }
-
-        case RecordValue::Type::Int: {
-          buffer << format("{}", value.get_int());
-          break;
-        }
-
-        case RecordValue::Type::Real: {
-          buffer << format("{}", value.get_real());
-          break;
-        }
-
-        case RecordValue::Type::String: {
-          buffer << format("{0}{1}{0}", _string_quote, value.get_string());
-          break;
-        }
-
-        case RecordValue::Type::Timestamp: {
-          buffer << format("{0}{1}{0}", _string_quote, format_timestamp(value.get_timestamp()));
-          break;
-        }
-
-        default: assert(false);
+        _line += _separator;
       }
+      if (const RecordValue* value = record->find(key)) {
+        append_value(*value);
+      }   // a field the record lacks is an empty column
     }
 
-    buffer.put('\n');
-    _output_stream->write(buffer.view().data(), buffer.view().size());
+    _line.push_back('\n');
+    _output_stream->write(_line.data(), static_cast<std::streamsize>(_line.size()));
     return true;
   }
 
@@ -299,12 +1715,57 @@ class Csv : public Sink {
   std::unique_ptr<std::ostream> _output_stream;
   std::mutex _mutex;
   std::vector<std::string> _fields;
+  std::vector<RecordKey> _field_keys;   // _fields resolved to ids, same order
+  std::string _line;   // reused per record; cleared, never reallocated
   bool _header;
   std::string_view _separator;
   std::string_view _string_quote;
+  RecordFilter _filter;
+  bool _compressed;
+
+  /// append one value in CSV form - locale-free, and allocation-free except
+  /// for timestamp formatting
+  void append_value(const RecordValue& value) {
+    switch (value.get_type()) {
+      case RecordValue::Type::Bool: {
+        append_bool(_line, value.get_bool());
+        break;
+      }
+
+      case RecordValue::Type::Int: {
+        append_number(_line, value.get_int());
+        break;
+      }
+
+      case RecordValue::Type::Real: {
+        append_number(_line, value.get_real());
+        break;
+      }
+
+      case RecordValue::Type::String: {
+        _line += _string_quote;
+        if (_string_quote.size() == 1) {   // double any embedded quotes
+          append_csv_quoted(_line, value.get_string(), _string_quote[0]);
+        } else {
+          _line += value.get_string();
+        }
+        _line += _string_quote;
+        break;
+      }
+
+      case RecordValue::Type::Timestamp: {
+        _line += _string_quote;
+        _line += format_timestamp(value.get_timestamp());
+        _line += _string_quote;
+        break;
+      }
+
+      default: assert(false);
+    }
+  }
 
   bool is_record_filtered(const Record& record) {
-    return false;
+    return !_filter.accepts(record);
   }
 };
 
@@ -312,7 +1773,7 @@ class Csv : public Sink {
 /// Create default sinks if write attempted and no sinks defined already
 // Defined here, so we can refer to the sink classes.
 void SinkManager::check_create_sinks() {
-  if (g_sink_manager._sinks.empty()) {
+  if (get_sink_manager()._workers.empty()) {
     Json::add_sink();
     // TODO: add other default sinks
   }
@@ -0,0 +1,267 @@
+// Copyright (c) 2022 Carlos Reyes
+// This code is licensed under the permissive MIT License (MIT).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#ifndef GIOPPLER_TEST_HPP
+#define GIOPPLER_TEST_HPP
+
+#if __cplusplus < 202002L
+#error C++20 or newer support required to use this library.
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "gioppler/config.hpp"
+#include "gioppler/counter.hpp"
+
+#if defined(GIOPPLER_PLATFORM_LINUX)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// -----------------------------------------------------------------------------
+namespace gioppler::test {
+
+// -----------------------------------------------------------------------------
+/// optional per-test performance budget, enforced with the perf counters
+// zero means "not budgeted"; a test that exceeds its budget fails even when
+// its answer is right, so CI catches performance regressions, not just wrong
+// answers - see bg_test_budget below
+struct TestBudget {
+  uint64_t _max_cpu_cycles   = 0;
+  uint64_t _max_cache_misses = 0;
+};
+
+// -----------------------------------------------------------------------------
+/// one registered test case
+// the body returns zero on success, like main()
+struct TestCase {
+  std::string_view _suite;
+  std::string_view _name;
+  std::function<int()> _body;
+  TestBudget _budget{};
+};
+
+// -----------------------------------------------------------------------------
+/// the test registry, filled by bg_test at static initialization time
+// a function-local static, so registration from other translation units is
+// safe regardless of global construction order
+inline std::vector<TestCase>& registered_tests() {
+  static std::vector<TestCase> tests;
+  return tests;
+}
+
+inline bool register_test(const std::string_view suite, const std::string_view name,
+                          std::function<int()> body, const TestBudget budget = {}) {
+  registered_tests().emplace_back(TestCase{suite, name, std::move(body), budget});
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// outcome of one test run, reported from the test's own process
+// plain data, so it can cross the result pipe with one read and one write
+struct TestResult {
+  int32_t  _exit_code;       // the body's return value; 128+signal on a crash
+  uint64_t _cpu_cycles;
+  uint64_t _cache_misses;
+  double   _duration_secs;
+};
+
+#if defined(GIOPPLER_PLATFORM_LINUX)
+// -----------------------------------------------------------------------------
+/// run one test in a forked child process
+// The fork buys per-test isolation: the child gets its own sink manager and
+// thread-local state, so test output never interleaves and a crashing test
+// takes down only itself. The child measures its own perf-counter delta and
+// reports it with the exit code through a pipe; if the child dies before
+// reporting, the wait status becomes the result.
+inline TestResult run_one_test(const TestCase& test_case) {
+  int result_pipe[2];
+  if (::pipe(result_pipe) == -1) {
+    return TestResult{._exit_code = 125};   // cannot isolate; treated as an error
+  }
+
+  std::fflush(nullptr);   // or the child inherits buffered output and reprints it
+  const pid_t child = ::fork();
+  if (child == 0) {
+    ::close(result_pipe[0]);
+    linux::LinuxEvents& events = linux::get_thread_events();
+    events.enable_events();
+
+    const auto start = std::chrono::steady_clock::now();
+    const linux::LinuxEventsData before = events.get_snapshot();
+
+    int exit_code;
+    try {
+      exit_code = test_case._body();
+    } catch (...) {
+      exit_code = 124;   // an escaped exception is a failure, not a crash
+    }
+
+    const linux::LinuxEventsData after = events.get_snapshot();
+    linux::LinuxEventsData delta = after-before;   // the getters are non-const
+    const TestResult result{
+        ._exit_code     = exit_code,
+        ._cpu_cycles    = delta.get_cpu_cycles(),
+        ._cache_misses  = delta.get_cache_misses(),
+        ._duration_secs = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now()-start).count()};
+    [[maybe_unused]] const ssize_t written = ::write(result_pipe[1], &result, sizeof(result));
+    ::_exit(0);   // skip static destructors; the parent owns the terminal
+  }
+
+  ::close(result_pipe[1]);
+  TestResult result{};
+  const ssize_t bytes_read = ::read(result_pipe[0], &result, sizeof(result));
+  ::close(result_pipe[0]);
+
+  int status = 0;
+  ::waitpid(child, &status, 0);
+  if (bytes_read != sizeof(result)) {   // child died before reporting
+    result = TestResult{};
+    result._exit_code = WIFSIGNALED(status) ? 128+WTERMSIG(status) : 126;
+  }
+  return result;
+}
+#else
+// -----------------------------------------------------------------------------
+/// fallback without process isolation for platforms without fork
+inline TestResult run_one_test(const TestCase& test_case) {
+  const auto start = std::chrono::steady_clock::now();
+  int exit_code;
+  try {
+    exit_code = test_case._body();
+  } catch (...) {
+    exit_code = 124;
+  }
+  return TestResult{
+      ._exit_code     = exit_code,
+      ._duration_secs = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now()-start).count()};
+}
+#endif // defined GIOPPLER_PLATFORM_LINUX
+
+// -----------------------------------------------------------------------------
+/// does the result stay within the test's budget? empty budgets always do
+inline bool within_budget(const TestBudget& budget, const TestResult& result) {
+  if (budget._max_cpu_cycles   && result._cpu_cycles   > budget._max_cpu_cycles)     return false;
+  if (budget._max_cache_misses && result._cache_misses > budget._max_cache_misses)   return false;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+/// run the registered tests and report; returns the count of failed tests
+// Usage: test_program [suite [test]] [-jN]
+// Tests run in parallel: one worker per core (or -jN), each claiming the
+// next unstarted test from the shared list, so a long test like ackermann4_1
+// never serializes the rest of the suite behind it.
+inline int run_all_tests(const int argc, const char* argv[]) {
+  std::string_view suite_filter, name_filter;
+  unsigned jobs = std::thread::hardware_concurrency();
+  for (int index = 1; index < argc; ++index) {
+    const std::string_view argument{argv[index]};
+    if (argument.starts_with("-j")) {
+      jobs = static_cast<unsigned>(std::atoi(argv[index]+2));
+    } else if (suite_filter.empty()) {
+      suite_filter = argument;
+    } else {
+      name_filter = argument;
+    }
+  }
+  if (jobs == 0)   jobs = 1;
+
+  std::vector<const TestCase*> selected;
+  for (const TestCase& test_case : registered_tests()) {
+    if (!suite_filter.empty() && test_case._suite != suite_filter)   continue;
+    if (!name_filter.empty()  && test_case._name  != name_filter)    continue;
+    selected.push_back(&test_case);
+  }
+
+  std::atomic<size_t> next_test{0};
+  std::atomic<int> failures{0};
+  std::mutex report_mutex;
+
+  const auto worker = [&] {
+    while (true) {
+      const size_t index = next_test.fetch_add(1, std::memory_order_relaxed);
+      if (index >= selected.size())   return;
+      const TestCase& test_case = *selected[index];
+
+      const TestResult result = run_one_test(test_case);
+      const bool budgeted = within_budget(test_case._budget, result);
+      if (result._exit_code != 0 || !budgeted)   failures.fetch_add(1);
+
+      const std::lock_guard<std::mutex> lock{report_mutex};
+      std::printf("%s %.*s.%.*s  %.3fs  %lu cycles  %lu cache misses",
+                  result._exit_code == 0 && budgeted ? "PASS" : "FAIL",
+                  static_cast<int>(test_case._suite.size()), test_case._suite.data(),
+                  static_cast<int>(test_case._name.size()),  test_case._name.data(),
+                  result._duration_secs,
+                  static_cast<unsigned long>(result._cpu_cycles),
+                  static_cast<unsigned long>(result._cache_misses));
+      if (result._exit_code != 0)   std::printf("  (exit %d)", result._exit_code);
+      if (!budgeted)                std::printf("  (over budget)");
+      std::printf("\n");
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    const unsigned worker_count = std::min<size_t>(jobs, selected.size());
+    workers.reserve(worker_count);
+    for (unsigned index = 0; index < worker_count; ++index) {
+      workers.emplace_back(worker);
+    }
+  }
+
+  std::printf("%zu tests, %d failed\n", selected.size(), failures.load());
+  return failures.load();
+}
+
+// -----------------------------------------------------------------------------
+}   // namespace gioppler::test
+
+// -----------------------------------------------------------------------------
+/// define and register a test case: bg_test(suite, name, { ...; return 0; })
+// the body is a block returning zero on success, like main(); each test
+// runs in its own process - see run_one_test
+#define bg_test(suite, name, ...) \
+  static const bool gioppler_test_registered_##suite##_##name = \
+      gioppler::test::register_test(#suite, #name, []() -> int __VA_ARGS__);
+
+/// like bg_test, but the test must also stay within the given perf budget
+// a budget of zero cycles or misses leaves that limit unenforced
+#define bg_test_budget(suite, name, max_cycles, max_misses, ...) \
+  static const bool gioppler_test_registered_##suite##_##name = \
+      gioppler::test::register_test(#suite, #name, []() -> int __VA_ARGS__, \
+          gioppler::test::TestBudget{(max_cycles), (max_misses)});
+
+// -----------------------------------------------------------------------------
+#endif // defined GIOPPLER_TEST_HPP
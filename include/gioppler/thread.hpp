@@ -32,6 +32,7 @@
 #include <mutex>
 
 #include "gioppler/utility.hpp"
+#include "gioppler/record.hpp"
 #include "gioppler/program.hpp"
 
 // -----------------------------------------------------------------------------
@@ -41,6 +42,7 @@ namespace gioppler {
 class Thread {
  public:
   Thread() {
+    (void) get_program();   // the first event anywhere materializes the program object
     const uint_fast64_t prev_threads_created = std::atomic_fetch_add(&_threads_created, 1);
     _thread_id = prev_threads_created + 1;
     std::atomic_fetch_add(&_threads_active, 1);
@@ -50,6 +52,11 @@ class Thread {
     std::atomic_fetch_sub(&_threads_active, 1);
   }
 
+  // Note: thread-local accumulations (e.g. profile shards) merge into their
+  // global tables from their own destructors, not from a hook here - this
+  // object can be torn down before them, so a callback run from here could
+  // read state that is already gone. See ProfileStore::ThreadShard.
+
   static bool all_threads_done() {
     return _threads_active == 0;
   }
@@ -58,14 +65,26 @@ class Thread {
     return _thread_id;
   }
 
+  /// pool used to recycle Record objects emitted from this thread
+  RecordPool& record_pool() {
+    return _record_pool;
+  }
+
  private:
   static inline std::atomic_uint_fast64_t _threads_created;
   static inline std::atomic_uint_fast64_t _threads_active;
   uint_fast64_t _thread_id;
+  RecordPool _record_pool;
 };
 
 // -----------------------------------------------------------------------------
-static inline thread_local Thread g_thread{};
+/// this thread's state, materialized by its first event
+// a function-local static, so threads that never emit a record never
+// construct it - and never run the exit callbacks or pool teardown either
+inline Thread& get_thread() {
+  static thread_local Thread thread;
+  return thread;
+}
 
 // -----------------------------------------------------------------------------
 }   // namespace gioppler
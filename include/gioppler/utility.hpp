@@ -35,6 +35,7 @@
 #include <random>
 #include <source_location>
 #include <syncstream>
+#include <thread>
 #include <unordered_map>
 #include <variant>
 using namespace std::literals;
@@ -42,6 +43,14 @@ using namespace std::literals;
 #include "gioppler/config.hpp"
 #include "gioppler/platform.hpp"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if defined(GIOPPLER_PLATFORM_LINUX)
+#include "gioppler/linux/uring.hpp"
+#endif
+
 // -----------------------------------------------------------------------------
 /// String formatting function
 #if defined(__cpp_lib_format)
@@ -85,6 +94,15 @@ struct pair_hash {
   }
 };
 
+/// transparent hash so string-keyed maps accept string_view lookups
+// avoids building a std::string just to probe the table
+struct string_hash {
+  using is_transparent = void;
+  std::size_t operator()(const std::string_view value) const {
+    return std::hash<std::string_view>{}(value);
+  }
+};
+
 // -----------------------------------------------------------------------------
 /// simplify creating shared pointers to unordered maps
 // forces the use of an initialization list constructor
@@ -151,7 +169,7 @@ std::filesystem::path create_filename(const std::string_view extension = "txt")
   const uint64_t process_id{get_process_id()};
   const uint32_t salt{generator() % 10'000};   // up to four digits
   const std::string extension_dot = (!extension.empty() && extension[0] != '.') ? "." : "";
-  const std::string filename{format("{}-{}-{}{}{}}", program_name, process_id, salt, extension_dot, extension)};
+  const std::string filename{format("{}-{}-{}{}{}", program_name, process_id, salt, extension_dot, extension)};
   return filename;
 }
 
@@ -178,6 +196,15 @@ get_output_filepath(const std::string_view directory = "<temp>"sv, const std::st
   const std::filesystem::path filename_path  = create_filename(extension);
   const std::filesystem::path full_path      = directory_path/filename_path;
   std::clog << "INFO: setting gioppler log to " << full_path << std::endl;
+
+#if defined(GIOPPLER_PLATFORM_LINUX)
+  // asynchronous writes: the sink's writer thread hands buffers to the
+  // kernel and keeps serializing instead of blocking when the filesystem
+  // stalls; falls back below when io_uring is unavailable
+  if (auto uring_stream = linux::make_uring_file_stream(full_path)) {
+    return uring_stream;
+  }
+#endif
   return std::make_unique<std::ofstream>(full_path, std::ios::trunc);
 }
 
@@ -185,10 +212,69 @@ get_output_filepath(const std::string_view directory = "<temp>"sv, const std::st
 using Timestamp = std::chrono::system_clock::time_point;
 using TimestampDiff = std::chrono::duration<double>;
 
+// -----------------------------------------------------------------------------
+/// calibrated TSC clock - cheap time source for timestamping records
+// system_clock::now() goes through the vdso; reading the invariant TSC is a
+// few cycles. The TSC frequency is measured against the system clock once
+// per process, and each thread keeps a (system time, TSC) anchor pair, so a
+// timestamp is one rdtsc plus a multiply-add. The anchor is refreshed from
+// the system clock once a second to bound drift. Falls back to the system
+// clock on architectures without a TSC.
+class TscClock {
+ public:
+  static Timestamp now() {
+#if defined(__x86_64__) || defined(__i386__)
+    static thread_local Anchor anchor{};
+    const uint64_t tsc = __rdtsc();
+    const uint64_t elapsed_ticks = tsc-anchor._tsc;
+    if (tsc < anchor._tsc || elapsed_ticks >= get_ticks_per_second()) [[unlikely]] {
+      anchor = Anchor{std::chrono::system_clock::now(), __rdtsc()};
+      return anchor._time;
+    }
+    const auto elapsed_ns = static_cast<int64_t>(
+        static_cast<double>(elapsed_ticks)*get_nanoseconds_per_tick());
+    return anchor._time+std::chrono::duration_cast<Timestamp::duration>(
+        std::chrono::nanoseconds{elapsed_ns});
+#else
+    return std::chrono::system_clock::now();
+#endif
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+ private:
+  /// a matched (system time, TSC) reading used as the extrapolation base
+  struct Anchor {
+    Timestamp _time{};
+    uint64_t _tsc = 0;
+  };
+
+  /// measure the TSC frequency against the system clock, once per process
+  // costs a few milliseconds the first time a timestamp is taken
+  static uint64_t get_ticks_per_second() {
+    static const uint64_t ticks_per_second = []{
+      const Timestamp time_start = std::chrono::system_clock::now();
+      const uint64_t tsc_start   = __rdtsc();
+      std::this_thread::sleep_for(5ms);
+      const Timestamp time_end = std::chrono::system_clock::now();
+      const uint64_t tsc_end   = __rdtsc();
+      const double elapsed_secs = TimestampDiff{time_end-time_start}.count();
+      return static_cast<uint64_t>(static_cast<double>(tsc_end-tsc_start)/elapsed_secs);
+    }();
+    return ticks_per_second;
+  }
+
+  static double get_nanoseconds_per_tick() {
+    static const double nanoseconds_per_tick =
+        1e9/static_cast<double>(get_ticks_per_second());
+    return nanoseconds_per_tick;
+  }
+#endif
+};
+
 // -----------------------------------------------------------------------------
 /// returns the current timestamp
 Timestamp now() {
-  return std::chrono::system_clock::now();
+  return TscClock::now();
 }
 
 // -----------------------------------------------------------------------------
@@ -204,8 +290,34 @@ std::string format_timestamp(const Timestamp ts)
 {
   const std::uint64_t timestamp_ns =
     std::chrono::duration_cast<std::chrono::nanoseconds>(ts.time_since_epoch()).count();
-  const std::uint64_t ns = timestamp_ns % 1000'000'000l;
-  return format("{0:%FT%T}.{1:09d}{0:%zZ}", ts, ns);
+  const std::uint64_t second = timestamp_ns / 1000'000'000l;
+  std::uint64_t ns           = timestamp_ns % 1000'000'000l;
+
+  // the date/time prefix and zone suffix only change when the second rolls
+  // over, so cache them per thread and only render the nanosecond digits
+  // on each call - the chrono formatter is far too slow to run per record
+  static thread_local std::uint64_t cached_second = UINT64_MAX;
+  static thread_local std::string cached_prefix;
+  static thread_local std::string cached_suffix;
+  if (second != cached_second) [[unlikely]] {
+    cached_second = second;
+    const auto whole_second = std::chrono::floor<std::chrono::seconds>(ts);
+    cached_prefix = format("{:%FT%T}", whole_second);
+    cached_suffix = format("{:%zZ}", ts);
+  }
+
+  std::string timestamp;
+  timestamp.reserve(cached_prefix.size()+10+cached_suffix.size());
+  timestamp += cached_prefix;
+  timestamp.push_back('.');
+  char digits[9];
+  for (int index = 8; index >= 0; --index) {
+    digits[index] = static_cast<char>('0'+(ns % 10));
+    ns /= 10;
+  }
+  timestamp.append(digits, sizeof(digits));
+  timestamp += cached_suffix;
+  return timestamp;
 }
 
 // -----------------------------------------------------------------------------
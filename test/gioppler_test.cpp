@@ -15,6 +15,7 @@
  */
 
 #include "gioppler/gioppler.hpp"
+#include "gioppler/test.hpp"
 
 // https://en.wikipedia.org/wiki/Ackermann_function
 // runs in about 9.5 seconds in debug mode for (4, 1)
@@ -29,11 +30,13 @@ bg_test(ackermann, ackermann4_1, {
     return !(result == 65533);
 })
 
-int main(int argc, const char** argv, const char** envp) {
-    bg_function("", "", 0, {
-        bg_add_sink("stderr", "all", "json header comments", NULL, NULL);
-        bg_add_sink("stderr", "all", "spaces header comments", NULL, NULL);
+// small and recursion-free, so a tight budget stays meaningful in debug
+// builds; the budget only binds where the hardware counters are available
+bg_test_budget(ackermann, ackermann2_3, 50'000'000, 1'000'000, {
+    const uint64_t result = ackermann(2, 3);
+    return !(result == 9);
+})
 
-    });
-    return 0;
+int main(const int argc, const char* argv[]) {
+    return gioppler::test::run_all_tests(argc, argv);
 }